@@ -117,6 +117,184 @@ def send_bind():
   enow_reset()
   print("Exited bind mode")
 
+# Over-the-air frame format of the transmitter firmware (see transmitterFW/lib/OTA/OTA.h)
+OTA_VERSION        = const(2)
+OTA_HEADER_LEN     = const(9) # version/type, sequence, TX timestamp, data age
+OTA_FRAME_CHANNELS = const(0)
+OTA_FRAME_KEYFRAME = const(1)
+OTA_FRAME_DELTA    = const(2)
+OTA_FRAME_HISTORY  = const(3)
+OTA_FRAME_CHANNEL_SWITCH = const(4)
+OTA_FRAME_FAILSAFE = const(5)
+OTA_FRAME_TELEMETRY = const(8)
+OTA_TELEMETRY_INTERVAL_MS = const(200)
+OTA_CHANNEL_REVERT_MS = const(1000) # back to wifi_channel, if the transmitter is not found on the new channel
+OTA_FAILSAFE_HOLD    = const(0) # keep the last channels
+OTA_FAILSAFE_NEUTRAL = const(1) # all channels to their center
+OTA_FAILSAFE_CUT     = const(2) # outputs off, as without the transmitter
+OTA_CHANNEL_MID      = const(992)
+OTA_LATE_US          = const(200000) # late frames were sent at most this long before the last one
+ota_keyframe = None # last received keyframe, the delta frames refer to
+ota_keyframe_id = 0
+ota_last = None # last decoded channels, kept by a hold failsafe frame
+ota_seq = None # sequence number of the last frame
+ota_lost = 0   # number of frames lost, from gaps in the sequence
+ota_late = 0   # number of duplicated or reordered frames, which were dropped
+ota_recovered = 0 # number of lost frames, which the next (history) frame could have rebuilt
+ota_tx_us = 0  # transmitter timestamp of the last frame
+ota_age_us = 0 # age of the channel data in the last frame, when it was sent
+ota_telemetry_ms = 0    # time the last telemetry frame was sent
+ota_loop_us = 0         # longest main loop time since the last telemetry frame
+ota_loop_last_us = None
+ota_home_channel = wifi_channel # configured WiFi channel, wifi_channel follows a channel switch
+ota_frame_ms = 0        # time the last frame from the transmitter was received
+
+def ota_unpack(data, count):
+  # 11 bits per channel, same bit order as the CRSF RC channels packet
+  ch = [0] * count
+  n = 0
+  bits = 0
+  value = 0
+  for b in data:
+    value |= b << bits
+    bits += 8
+    if bits >= 11:
+      ch[n] = value & 0x7FF
+      value >>= 11
+      bits -= 11
+      n += 1
+      if n == count:
+        break
+  return ch
+
+def ota_history_len(msg):
+  # Length of the history frame in msg as given by its content, -1 if it is cut short
+  groups = msg[OTA_HEADER_LEN] & 0x0F
+  if groups > 4:
+    return -1
+  pos = OTA_HEADER_LEN + 1 + groups * 11
+  for r in range(msg[OTA_HEADER_LEN] >> 4):
+    if pos + groups > len(msg):
+      return -1
+    changed = 0
+    for b in msg[pos:pos + groups]:
+      while b:
+        changed += b & 1
+        b >>= 1
+    pos += groups + (changed * 11 + 7) // 8
+  return pos
+
+def ota_decode(msg):
+  # Returns a list of 32 channel values or None, if msg is not a (decodable) channel frame
+  global ota_keyframe, ota_keyframe_id, ota_seq, ota_lost, ota_late, ota_recovered, ota_tx_us, ota_age_us, ota_frame_ms, ota_last
+  if len(msg) == 64 and not (msg[0] == (OTA_VERSION << 4) | OTA_FRAME_HISTORY and ota_history_len(msg) == 64):
+    # Raw 32 x uint16 channel array, sent by transmitter firmware before OTA version 1. A history
+    # frame of 32 channels may have the same length, it is told apart by its header and content.
+    return struct.unpack('<HHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHH', msg)
+  if len(msg) == OTA_HEADER_LEN + 1 and msg[0] == (OTA_VERSION << 4) | OTA_FRAME_CHANNEL_SWITCH:
+    ota_switch_channel(msg[OTA_HEADER_LEN])
+    return None
+  if len(msg) < OTA_HEADER_LEN + 1 or (msg[0] >> 4) != OTA_VERSION:
+    return None
+  frametype = msg[0] & 0x0F
+  if len(msg) == OTA_HEADER_LEN + 1 and frametype != OTA_FRAME_FAILSAFE:
+    return None
+  ota_frame_ms = utime.ticks_ms()
+  seq, tx_us, age_us = struct.unpack_from('<HIH', msg, 1)
+  missed = 0
+  if ota_seq != None:
+    diff = ((seq - ota_seq + 0x8000) & 0xFFFF) - 0x8000
+    # A frame with an older sequence number which was sent later, or long before the last
+    # frame, comes from a transmitter which restarted, its new sequence is followed right away
+    sent_before_us = (ota_tx_us - tx_us) & 0xFFFFFFFF
+    restarted = diff <= -256 or (sent_before_us > OTA_LATE_US and (diff <= 0 or sent_before_us < 0x80000000))
+    if diff <= 0 and not restarted:
+      ota_late += 1
+      return None # Duplicate or older than the last frame
+    if diff > 0 and not restarted:
+      missed = diff - 1
+      ota_lost += missed
+  ota_seq = seq
+  ota_tx_us = tx_us
+  ota_age_us = age_us
+  if frametype == OTA_FRAME_CHANNELS and (len(msg) - OTA_HEADER_LEN) % 11 == 0:
+    ch = ota_unpack(msg[OTA_HEADER_LEN:], (len(msg) - OTA_HEADER_LEN) // 11 * 8)
+  elif frametype == OTA_FRAME_KEYFRAME and (len(msg) - OTA_HEADER_LEN - 1) % 11 == 0:
+    ota_keyframe = ota_unpack(msg[OTA_HEADER_LEN + 1:], (len(msg) - OTA_HEADER_LEN - 1) // 11 * 8)
+    ota_keyframe_id = msg[OTA_HEADER_LEN]
+    ch = list(ota_keyframe)
+  elif frametype == OTA_FRAME_DELTA:
+    if ota_keyframe == None or msg[OTA_HEADER_LEN] != ota_keyframe_id:
+      return None # Keyframe lost, wait for the next one
+    # Bitmap of the channels that changed since the keyframe, followed by their values
+    bitmap = OTA_HEADER_LEN + 1
+    nbitmap = len(ota_keyframe) // 8
+    changed = [n for n in range(len(ota_keyframe)) if msg[bitmap + n // 8] & (1 << (n % 8))]
+    values = ota_unpack(msg[bitmap + nbitmap:], len(changed))
+    ch = list(ota_keyframe)
+    for i in range(len(changed)):
+      ch[changed[i]] = values[i]
+  elif frametype == OTA_FRAME_HISTORY and len(msg) >= OTA_HEADER_LEN + 1 + (msg[OTA_HEADER_LEN] & 0x0F) * 11:
+    # The newest channels are followed by records of the previous frames. Only the newest
+    # channels are needed to drive the model, the records are only counted here.
+    ch = ota_unpack(msg[OTA_HEADER_LEN + 1:], (msg[OTA_HEADER_LEN] & 0x0F) * 8)
+    ota_recovered += min(missed, msg[OTA_HEADER_LEN] >> 4)
+  elif frametype == OTA_FRAME_FAILSAFE and len(msg) == OTA_HEADER_LEN + 1:
+    # The transmitter lost the handset, a cut is handled by the caller, see ota_failsafe_cut()
+    if msg[OTA_HEADER_LEN] == OTA_FAILSAFE_HOLD:
+      return ota_last
+    if msg[OTA_HEADER_LEN] == OTA_FAILSAFE_NEUTRAL:
+      return [OTA_CHANNEL_MID] * 32
+    return None
+  else:
+    return None
+  ota_last = ch + [0] * (32 - len(ch))
+  return ota_last
+
+def ota_failsafe_cut(msg):
+  # True if msg is a failsafe frame asking to cut the outputs, as done when no frame arrives
+  if len(msg) == OTA_HEADER_LEN + 1 and msg[0] == (OTA_VERSION << 4) | OTA_FRAME_FAILSAFE and msg[OTA_HEADER_LEN] == OTA_FAILSAFE_CUT:
+    ota_decode(msg) # Keeps the sequence in step
+    return True
+  return False
+
+def ota_switch_channel(channel):
+  # Follow the transmitter to a quieter WiFi channel, see ota_channel_timeout() for the way back
+  global wifi_channel, ota_frame_ms
+  if channel < 1 or channel > 11 or channel == wifi_channel:
+    return
+  wifi_channel = channel
+  network.WLAN(network.STA_IF).config(channel=channel)
+  ota_frame_ms = utime.ticks_ms()
+
+def ota_channel_timeout():
+  # Called when no frame arrived, returns to the configured channel if the transmitter
+  # did not show up on the one it announced. wifi_reset() then applies wifi_channel.
+  global wifi_channel
+  if wifi_channel != ota_home_channel and utime.ticks_diff(utime.ticks_ms(), ota_frame_ms) > OTA_CHANNEL_REVERT_MS:
+    wifi_channel = ota_home_channel
+
+def ota_send_telemetry(host, battery_mv):
+  # Reports the battery voltage (0 if not measured), the RSSI of the frames from the
+  # transmitter and the main loop time back to the transmitter, every OTA_TELEMETRY_INTERVAL_MS
+  global ota_telemetry_ms, ota_loop_us, ota_loop_last_us
+  now_us = utime.ticks_us()
+  if ota_loop_last_us != None:
+    ota_loop_us = max(ota_loop_us, utime.ticks_diff(now_us, ota_loop_last_us))
+  ota_loop_last_us = now_us
+  if utime.ticks_diff(utime.ticks_ms(), ota_telemetry_ms) < OTA_TELEMETRY_INTERVAL_MS:
+    return
+  ota_telemetry_ms = utime.ticks_ms()
+  try:
+    try:
+      e.get_peer(host)
+    except OSError:
+      e.add_peer(host) # Transmitter is not a peer yet, or ESP-NOW was reset
+    rssi = e.peers_table[host][0]
+    e.send(host, struct.pack('<BHbH', (OTA_VERSION << 4) | OTA_FRAME_TELEMETRY, battery_mv, max(-128, min(rssi, 127)), min(ota_loop_us, 0xFFFF)), False)
+  except OSError:
+    pass # Telemetry is optional, never stop the model for it
+  ota_loop_us = 0
 # Drive NeoPixel on CyberBrick Core
 npcore = Pin(8, Pin.OUT)
 np = NeoPixel(npcore, 1)
@@ -173,7 +351,7 @@ while True:
   try:
     # Receive message (host MAC, message, 500ms failsafe timeout)
     host, msg = e.recv(500)
-    if msg == None:
+    if msg == None or ota_failsafe_cut(msg):
       # Failsafe
       # Motor off, no change to steering
       M1A.duty_u16(0)
@@ -191,13 +369,17 @@ while True:
           LEDstring2[i] = (255, 0, 0) # All red
       LEDstring2.write()
 
-      e.active(False)
-      wifi_reset()
-      enow_reset()
+      if msg == None:
+        # Nothing received, restart the radio
+        e.active(False)
+        ota_channel_timeout() # Back to wifi_channel, if the transmitter did not follow a channel switch
+        wifi_reset()
+        enow_reset()
 
     else:
-      if len(msg) > 63:
-        ch = struct.unpack('<HHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHH', msg)
+      ch = ota_decode(msg)
+      if ch != None:
+        ota_send_telemetry(host, 0) # The CyberBrick Core does not measure the battery voltage
         if len(ch) == 32:
           # Received expected CRSF telegram channel count from the handset
           # Blink green
@@ -268,7 +450,7 @@ while True:
               M2B.duty_u16((int)(max(min(PWMGAINCOEFFICIENTNEG*(CRSF_CHANNEL_VALUE_MID-lefttrack), FULLSCALE16BIT),0)))
 
       else:
-        # Unexpected message length - blink yellow
+        # Unexpected message - blink yellow
         if ((utime.ticks_ms() % blinkertime_ms) > (blinkertime_ms / 2)):
           np[0] = (0, 0, 0) # Dark phase
         else:
@@ -21,6 +21,7 @@
 
 #pragma once
 #include <Arduino.h>
+#include "TripleBuffer.h"
 
 #undef ICACHE_RAM_ATTR //fix to allow both esp32 and esp8266 to use ICACHE_RAM_ATTR for mapping to IRAM
 #define ICACHE_RAM_ATTR IRAM_ATTR
@@ -28,6 +29,27 @@
 #define GPIO_PIN_BOOT0 0
 #define CRSF_NUM_CHANNELS 32U
 #define RF_FRAME_RATE_US 20000U // 50 Hz
+#define LINK_STATS_INTERVAL_MS 200U // LinkStatistics telemetry to the handset
+#define LINK_STATS_LQ_WINDOW 100     // number of frames the link quality is calculated over
+#define TELEMETRY_TIMEOUT_MS 1000U   // telemetry from a receiver is discarded when older than this
+#define BIND_TIMEOUT_MS 30000U       // bind mode ends if no receiver was heard within this time
+#define HANDSET_INPUT_MAX_WAIT_MS 10U // loop() runs at least this often without handset data
+
+// Failsafe on the loss of the handset, the channels are overdue after this many packet intervals,
+// but no earlier than FAILSAFE_DETECT_MIN_US to ride out the jitter of the handset frames
+#define FAILSAFE_DETECT_INTERVALS 4
+#define FAILSAFE_DETECT_MIN_US 20000U
+#define FAILSAFE_BURST_FRAMES 5         // failsafe frames sent to every receiver right after the loss
+#define FAILSAFE_BURST_INTERVAL_MS 2U
+#define FAILSAFE_KEEPALIVE_MS 100U      // failsafe frame interval once the RF timer is stopped
+
+// The ESP-NOW frames are sent from a dedicated task, woken up by the RF timer interrupt.
+// By default it runs next to the WiFi stack on core 0, away from the handset UART handling in loop() on core 1.
+#if !defined(RF_SEND_TASK_CORE)
+#define RF_SEND_TASK_CORE 0
+#endif
+#define RF_SEND_TASK_PRIORITY (configMAX_PRIORITIES - 3) // just below the WiFi task
+#define RF_SEND_TASK_STACK_SIZE 4096
 
 typedef enum
 {
@@ -43,4 +65,20 @@ inline void setConnectionState(connectionState_e newState) {
     connectionState = newState;
 }
 
-extern volatile uint16_t ChannelData[CRSF_NUM_CHANNELS]; // Current state of channels, CRSF format
+extern uint16_t ChannelData[CRSF_NUM_CHANNELS]; // Channels as being received from the handset, CRSF format
+
+// Complete and consistent set of channels, as handed over from the handset to the RF side
+typedef struct {
+    uint16_t ch[CRSF_NUM_CHANNELS];
+    uint8_t count;   // number of valid channels, 16 or 32
+    uint32_t recvUS; // micros() when the (last part of the) set was received from the handset
+} channelSnapshot_t;
+
+extern TripleBuffer<channelSnapshot_t> ChannelSnapshot;
+
+// Part of the handset channels sent to one model in multi-model mode
+typedef struct {
+    uint8_t model;        // index into cyberbrickRxMAC
+    uint8_t firstChannel; // 1 for CH1
+    uint8_t count;        // multiple of 8
+} multiModelSlice_t;
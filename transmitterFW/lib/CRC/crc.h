@@ -21,31 +21,125 @@
 
 #pragma once
 #include <stdint.h>
+#if defined(ARDUINO)
 #include "common.h"
+#endif
+
+#ifndef ICACHE_RAM_ATTR
+#define ICACHE_RAM_ATTR
+#endif
+#ifndef DRAM_ATTR
+#define DRAM_ATTR
+#endif
 
 #define crclen 256
 
+/*
+ * The lookup tables are generated by the compiler, so a CRC object defined constexpr costs no time
+ * at startup. Where the object lives decides where its table lives: define it with CRC_TABLE_ATTR
+ * to keep the table in DRAM, which unlike flash is not slowed down by cache misses while the WiFi
+ * driver runs from flash. Define CRC_TABLES_IN_FLASH to save the DRAM instead. IRAM is no option,
+ * it only allows 32-bit wide reads.
+ */
+#ifdef CRC_TABLES_IN_FLASH
+#define CRC_TABLE_ATTR
+#else
+#define CRC_TABLE_ATTR DRAM_ATTR
+#endif
+
+/**
+ * @brief CRC8, MSB first, of polynomial Poly
+ *
+ * With Slices = 4, calc() processes 4 bytes per step using 4 tables (1 kB). This does not save
+ * table lookups, but only the first of them depends on the previous step, which shortens the chain
+ * of dependent loads per byte.
+ */
+template <uint8_t Poly, uint8_t Slices = 1>
 class GENERIC_CRC8
 {
+    static_assert(Slices == 1 || Slices == 4, "slice-by-1 or slice-by-4 only");
+
 private:
-    uint8_t crc8tab[crclen];
-    uint8_t crcpoly;
+    uint8_t crc8tab[Slices][crclen] = {};
 
 public:
-    GENERIC_CRC8(uint8_t poly);
-    uint8_t calc(const uint8_t data);
-    uint8_t calc(const uint8_t *data, uint16_t len, uint8_t crc = 0);
+    constexpr GENERIC_CRC8()
+    {
+        for (uint16_t i = 0; i < crclen; i++)
+        {
+            uint8_t crc = i;
+            for (uint8_t j = 0; j < 8; j++)
+            {
+                crc = (crc << 1) ^ ((crc & 0x80) ? Poly : 0);
+            }
+            crc8tab[0][i] = crc;
+        }
+        // Table s holds the CRC of a byte followed by s zero bytes
+        for (uint8_t s = 1; s < Slices; s++)
+        {
+            for (uint16_t i = 0; i < crclen; i++)
+            {
+                crc8tab[s][i] = crc8tab[0][crc8tab[s - 1][i]];
+            }
+        }
+    }
+
+    uint8_t ICACHE_RAM_ATTR calc(const uint8_t data) const
+    {
+        return crc8tab[0][data];
+    }
+
+    uint8_t ICACHE_RAM_ATTR calc(const uint8_t *data, uint16_t len, uint8_t crc = 0) const
+    {
+        if constexpr (Slices == 4)
+        {
+            while (len >= 4)
+            {
+                crc = crc8tab[3][crc ^ data[0]] ^ crc8tab[2][data[1]] ^ crc8tab[1][data[2]] ^ crc8tab[0][data[3]];
+                data += 4;
+                len -= 4;
+            }
+        }
+        while (len--)
+        {
+            crc = crc8tab[0][crc ^ *data++];
+        }
+        return crc;
+    }
 };
 
+/**
+ * @brief CRC of Bits (9 to 16) bits, MSB first, of polynomial Poly
+ */
+template <uint8_t Bits, uint16_t Poly>
 class Crc2Byte
 {
+    static_assert(Bits > 8 && Bits <= 16, "CRC width out of range");
+
 private:
-    uint16_t _crctab[crclen];
-    uint8_t  _bits;
-    uint16_t _bitmask;
-    uint16_t _poly;
+    uint16_t _crctab[crclen] = {};
 
 public:
-    void init(uint8_t bits, uint16_t poly);
-    uint16_t calc(uint8_t *data, uint8_t len, uint16_t crc);
+    constexpr Crc2Byte()
+    {
+        const uint16_t highbit = 1 << (Bits - 1);
+        for (uint16_t i = 0; i < crclen; i++)
+        {
+            uint16_t crc = i << (Bits - 8);
+            for (uint8_t j = 0; j < 8; j++)
+            {
+                crc = (crc << 1) ^ ((crc & highbit) ? Poly : 0);
+            }
+            _crctab[i] = crc;
+        }
+    }
+
+    uint16_t ICACHE_RAM_ATTR calc(const uint8_t *data, uint8_t len, uint16_t crc) const
+    {
+        while (len--)
+        {
+            crc = (crc << 8) ^ _crctab[((crc >> (Bits - 8)) ^ (uint16_t) *data++) & 0x00FF];
+        }
+        return crc & (uint16_t)((1UL << Bits) - 1);
+    }
 };
@@ -0,0 +1,162 @@
+/*
+ * This file belongs to the CyberBrick ESP-NOW transmitter & receiver project, hosted originally at:
+ * https://github.com/rotorman/CyberBrick_ESPNOW
+ * Copyright (C) 2025, Risto Kõiva
+ *
+ * License GPL-3.0: https://www.gnu.org/licenses/gpl-3.0.html
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "ChannelSurvey.h"
+
+/**
+ * Share of the listening time the channel itself was busy, in 0.1 %
+ **/
+static uint32_t channelOccupancy(const channelSurveyResult_t &result)
+{
+    if (result.dwellUS == 0)
+        return 0;
+    const uint64_t busyUS = (uint64_t)result.airtimeUS + (uint64_t)result.packets * CHANNEL_SURVEY_PACKET_COST_US;
+    const uint64_t permille = busyUS * 1000 / result.dwellUS;
+    return permille > 1000 ? 1000 : (uint32_t)permille;
+}
+
+uint32_t ChannelSurveyScore(const channelSurveyResult_t *results, uint8_t channel)
+{
+    uint32_t score = 0;
+    for (int8_t offset = -CHANNEL_SURVEY_OVERLAP; offset <= CHANNEL_SURVEY_OVERLAP; offset++)
+    {
+        const int8_t neighbour = channel + offset;
+        if (neighbour < 1 || neighbour > CHANNEL_SURVEY_CHANNELS)
+            continue;
+        const uint8_t weight = CHANNEL_SURVEY_OVERLAP + 1 - (offset < 0 ? -offset : offset);
+        score += channelOccupancy(results[neighbour - 1]) * weight;
+    }
+    return score / (CHANNEL_SURVEY_OVERLAP + 1);
+}
+
+uint8_t ChannelSurveySelect(const channelSurveyResult_t *results, uint8_t homeChannel)
+{
+    uint8_t best = homeChannel;
+    uint32_t bestScore = ChannelSurveyScore(results, homeChannel);
+    const uint32_t homeScore = bestScore;
+    for (uint8_t channel = 1; channel <= CHANNEL_SURVEY_CHANNELS; channel++)
+    {
+        const uint32_t score = ChannelSurveyScore(results, channel);
+        if (score < bestScore)
+        {
+            best = channel;
+            bestScore = score;
+        }
+    }
+
+    // Moving costs a handshake with every receiver, it has to pay off
+    if (bestScore * 100 > homeScore * (100 - CHANNEL_SURVEY_MIN_GAIN_PERCENT))
+        return homeChannel;
+    return best;
+}
+
+void ChannelSwitch::begin(uint8_t home, uint8_t target, uint8_t peers, uint32_t nowMS)
+{
+    homeChannel = home;
+    targetChannel = target;
+    peerCount = peers < CHANNEL_SWITCH_MAX_PEERS ? peers : CHANNEL_SWITCH_MAX_PEERS;
+    // Announce as soon as the first receiver is heard
+    setState(STATE_HOME, nowMS - CHANNEL_SWITCH_RETRY_MS);
+}
+
+void ChannelSwitch::setState(state_e newState, uint32_t nowMS, uint32_t acked)
+{
+    ackedMask.store(acked, std::memory_order_relaxed);
+    waitingMask = (newState == STATE_ANNOUNCE) ? acked : 0;
+    stateMS = nowMS;
+    state.store(newState, std::memory_order_release);
+}
+
+uint32_t ChannelSwitch::getHeardMask(uint32_t nowMS) const
+{
+    const uint32_t heard = heardMask.load(std::memory_order_acquire);
+    uint32_t mask = 0;
+    for (uint8_t peer = 0; peer < peerCount; peer++)
+    {
+        if ((heard & (1UL << peer)) && nowMS - lastAckMS[peer] < CHANNEL_SWITCH_LOST_MS)
+            mask |= 1UL << peer;
+    }
+    return mask;
+}
+
+void ICACHE_RAM_ATTR ChannelSwitch::ackReceived(uint8_t peer, uint32_t nowMS)
+{
+    if (peer >= peerCount)
+        return;
+    lastAckMS[peer] = nowMS;
+    heardMask.fetch_or(1UL << peer, std::memory_order_release);
+    if (state.load(std::memory_order_acquire) == STATE_ANNOUNCE)
+        ackedMask.fetch_or(1UL << peer, std::memory_order_relaxed);
+}
+
+void ChannelSwitch::update(uint32_t nowMS)
+{
+    const uint32_t restarted = restartPeers.exchange(0, std::memory_order_acquire);
+    if (restarted != 0)
+    {
+        // The new receivers start on the configured channel, the others keep waiting where they are
+        heardMask.fetch_and(~restarted, std::memory_order_relaxed);
+        if (targetChannel != homeChannel)
+        {
+            const uint32_t waiting = (state == STATE_HOME) ? 0 : ackedMask.load(std::memory_order_relaxed) & ~restarted;
+            setState(STATE_ANNOUNCE, nowMS, waiting);
+        }
+    }
+
+    switch (state.load(std::memory_order_relaxed))
+    {
+    case STATE_HOME:
+        if (targetChannel != homeChannel && nowMS - stateMS >= CHANNEL_SWITCH_RETRY_MS && getHeardMask(nowMS) != 0)
+            setState(STATE_ANNOUNCE, nowMS);
+        break;
+
+    case STATE_ANNOUNCE:
+    {
+        const uint32_t allPeers = (peerCount >= 32) ? 0xFFFFFFFFUL : ((1UL << peerCount) - 1);
+        const uint32_t acked = ackedMask.load(std::memory_order_relaxed);
+        const bool pending = (getHeardMask(nowMS) & ~acked) != 0;
+        if (acked != 0 && !pending && (acked == allPeers || nowMS - stateMS >= CHANNEL_SWITCH_LISTEN_MS))
+            setState(STATE_SWITCHED, nowMS, acked);
+        else if (nowMS - stateMS >= CHANNEL_SWITCH_ANNOUNCE_MS)
+        {
+            // Receivers which waited on the new channel during the announcement are not left there
+            if (waitingMask != 0)
+                setState(STATE_SWITCHED, nowMS, acked);
+            else
+                setState(STATE_HOME, nowMS);
+        }
+        break;
+    }
+
+    case STATE_SWITCHED:
+    {
+        const uint32_t switched = ackedMask.load(std::memory_order_relaxed);
+        uint32_t silent = 0;
+        for (uint8_t peer = 0; peer < peerCount; peer++)
+        {
+            if ((switched & (1UL << peer)) && nowMS - lastAckMS[peer] >= CHANNEL_SWITCH_LOST_MS)
+                silent |= 1UL << peer;
+        }
+        if (silent == switched)
+            setState(STATE_HOME, nowMS);
+        else if (silent != 0)
+            ackedMask.fetch_and(~silent, std::memory_order_relaxed);
+        break;
+    }
+    }
+}
@@ -0,0 +1,155 @@
+/*
+ * This file belongs to the CyberBrick ESP-NOW transmitter & receiver project, hosted originally at:
+ * https://github.com/rotorman/CyberBrick_ESPNOW
+ * Copyright (C) 2025, Risto Kõiva
+ *
+ * License GPL-3.0: https://www.gnu.org/licenses/gpl-3.0.html
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+#ifndef ICACHE_RAM_ATTR
+#define ICACHE_RAM_ATTR
+#endif
+
+/*
+ * Selection of the least congested WiFi channel from a survey of the channel occupancy and the
+ * handshake which moves the receivers over to it. Neither depends on the WiFi driver, the survey
+ * samples are collected by the caller.
+ */
+
+#define CHANNEL_SURVEY_CHANNELS 11         // WiFi channels 1-11, as allowed in all regions
+#define CHANNEL_SURVEY_DWELL_MS 100        // listening time per channel
+#define CHANNEL_SURVEY_PACKET_COST_US 50   // channel access time (DIFS and backoff) counted per packet heard
+#define CHANNEL_SURVEY_OVERLAP 4           // 22 MHz wide channels 5 MHz apart overlap up to 4 channels away
+#define CHANNEL_SURVEY_MIN_GAIN_PERCENT 25 // only move if the best channel is this much quieter
+
+#define CHANNEL_SWITCH_ANNOUNCE_MS 500     // time for all receivers to acknowledge the switch
+#define CHANNEL_SWITCH_LISTEN_MS 100       // shortest announcement, for receivers not heard before to acknowledge
+#define CHANNEL_SWITCH_RETRY_MS 5000       // back on the configured channel before announcing again
+#define CHANNEL_SWITCH_LOST_MS 2000        // no acknowledgement from a receiver, it is off or on another channel
+#define CHANNEL_SWITCH_MAX_PEERS 32
+
+typedef struct
+{
+    uint32_t packets;   // frames received from other stations
+    uint32_t airtimeUS; // airtime of these frames
+    uint32_t dwellUS;   // time spent listening on the channel
+} channelSurveyResult_t;
+
+/**
+ * @brief Occupancy of a channel in 0.1 %, including the neighbouring channels weighted by their overlap
+ * @param results survey results of channels 1 to CHANNEL_SURVEY_CHANNELS
+ * @param channel WiFi channel, 1 to CHANNEL_SURVEY_CHANNELS
+ */
+uint32_t ChannelSurveyScore(const channelSurveyResult_t *results, uint8_t channel);
+
+/**
+ * @brief Pick the quietest channel, keeping the configured one unless another is clearly better
+ * @param results survey results of channels 1 to CHANNEL_SURVEY_CHANNELS
+ * @param homeChannel the configured WiFi channel, which all receivers start on
+ * @return the WiFi channel to use
+ */
+uint8_t ChannelSurveySelect(const channelSurveyResult_t *results, uint8_t homeChannel);
+
+/**
+ * @brief Handshake moving the transmitter and its receivers from the configured to another channel
+ *
+ * While announcing, the transmitter sends OTA_FRAME_CHANNEL_SWITCH frames on the configured channel
+ * to every receiver which has not acknowledged one yet. Only receivers which acknowledged a frame
+ * within CHANNEL_SWITCH_LOST_MS are waited for, a receiver which is off or whose channels are not
+ * sent never acknowledges and does not hold up the others. Once all of them did, the transmitter
+ * follows them to the new channel. If they do not within CHANNEL_SWITCH_ANNOUNCE_MS, the transmitter
+ * stays on the configured channel and announces again after CHANNEL_SWITCH_RETRY_MS, the receivers
+ * which already moved return there on their own.
+ *
+ * On the new channel, a receiver which goes silent is given up, only once all are silent the
+ * transmitter returns to the configured channel. A new receiver, e.g. after a model change, is
+ * announced to from the configured channel while the others wait on the new one. The announcement
+ * ends before the waiting receivers return on their own, also if the new receiver does not answer.
+ *
+ * ackReceived() is called from the ESP-NOW send callback, restart() from any task, everything else
+ * from the task sending the frames.
+ */
+class ChannelSwitch
+{
+public:
+    /**
+     * @brief Start moving to targetChannel, nothing happens if it is the home channel
+     */
+    void begin(uint8_t homeChannel, uint8_t targetChannel, uint8_t peerCount, uint32_t nowMS);
+
+    /**
+     * @brief Announce the switch again to receivers which start on the configured channel
+     * @param peers bitmap of the peers with a different receiver, e.g. after a model change
+     */
+    void restart(uint32_t peers) { restartPeers.fetch_or(peers, std::memory_order_release); }
+
+    /**
+     * @brief Record an acknowledged frame of a receiver
+     */
+    void ICACHE_RAM_ATTR ackReceived(uint8_t peer, uint32_t nowMS);
+
+    /**
+     * @brief Advance the handshake, getChannel() may change afterwards
+     */
+    void update(uint32_t nowMS);
+
+    /**
+     * @return the WiFi channel the transmitter has to be on
+     */
+    uint8_t getChannel() const { return state == STATE_SWITCHED ? targetChannel : homeChannel; }
+
+    /**
+     * @return true if the receiver is to get an OTA_FRAME_CHANNEL_SWITCH frame instead of the channels
+     */
+    bool isAnnouncingTo(uint8_t peer) const
+    {
+        return state == STATE_ANNOUNCE && !(ackedMask.load(std::memory_order_relaxed) & (1UL << peer));
+    }
+
+    /**
+     * @return true if the receiver has acknowledged the switch and waits on the new channel
+     */
+    bool hasSwitched(uint8_t peer) const
+    {
+        return state == STATE_ANNOUNCE && (ackedMask.load(std::memory_order_relaxed) & (1UL << peer));
+    }
+
+    uint8_t getTargetChannel() const { return targetChannel; }
+
+private:
+    typedef enum : uint8_t
+    {
+        STATE_HOME,     // on the configured channel, sending the channels
+        STATE_ANNOUNCE, // on the configured channel, sending the switch frames
+        STATE_SWITCHED  // on the target channel
+    } state_e;
+
+    void setState(state_e newState, uint32_t nowMS, uint32_t acked = 0);
+    uint32_t getHeardMask(uint32_t nowMS) const;
+
+    std::atomic<state_e> state {STATE_HOME};
+    std::atomic<uint32_t> ackedMask {0};    // acknowledged the switch, i.e. on the new channel
+    std::atomic<uint32_t> heardMask {0};    // acknowledged a frame at least once, see lastAckMS
+    std::atomic<uint32_t> restartPeers {0};
+    uint32_t lastAckMS[CHANNEL_SWITCH_MAX_PEERS] = {};
+    uint32_t waitingMask = 0;               // on the new channel since before the announcement
+    uint32_t stateMS = 0;
+    uint8_t homeChannel = 0;
+    uint8_t targetChannel = 0;
+    uint8_t peerCount = 0;
+};
@@ -0,0 +1,73 @@
+/*
+ * This file belongs to the CyberBrick ESP-NOW transmitter & receiver project, hosted originally at:
+ * https://github.com/rotorman/CyberBrick_ESPNOW
+ * Copyright (C) 2025, Risto Kõiva
+ *
+ * License GPL-3.0: https://www.gnu.org/licenses/gpl-3.0.html
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * @brief Tells when the RC channels frames from the handset make up a complete channel set
+ *
+ * With more than 16 channels, EdgeTX sends CRSF_FRAMETYPE_RC_CHANNELS_PACKED with channels 1-16 and
+ * CRSF_FRAMETYPE_RC_EXTENDED_CHANNELS_PACKED with channels 17-32 right after it, and the set is complete
+ * with the second one. Once the handset stops sending the upper half, e.g. after switching to a model
+ * with 16 channels, the next lower half without an upper half in between ends the extended mode, so
+ * that the sets of 16 channels are published again.
+ */
+class CrsfChannelSet
+{
+public:
+    /**
+     * @brief An RC channels frame was received
+     * @param upperHalf the frame is CRSF_FRAMETYPE_RC_EXTENDED_CHANNELS_PACKED
+     * @return number of channels of the now complete set, 0 while the set waits for its upper half
+     */
+    uint8_t add(bool upperHalf)
+    {
+        if (upperHalf)
+        {
+            extended = true;
+            lowerPending = false;
+            return 2 * CHANNELS_PER_FRAME;
+        }
+        if (lowerPending)
+            extended = false; // no upper half since the last lower half
+        lowerPending = extended;
+        return extended ? 0 : CHANNELS_PER_FRAME;
+    }
+
+    /**
+     * @return true while the handset sends channels 17-32
+     */
+    bool isExtended() const { return extended; }
+
+    /**
+     * @brief Start over with 16 channels, e.g. after the handset was lost
+     */
+    void reset()
+    {
+        extended = false;
+        lowerPending = false;
+    }
+
+private:
+    static constexpr uint8_t CHANNELS_PER_FRAME = 16;
+
+    volatile bool extended = false;
+    bool lowerPending = false; // a lower half was received and its upper half has not arrived yet
+};
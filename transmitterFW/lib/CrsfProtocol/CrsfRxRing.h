@@ -0,0 +1,185 @@
+/*
+ * This file belongs to the CyberBrick ESP-NOW transmitter & receiver project, hosted originally at:
+ * https://github.com/rotorman/CyberBrick_ESPNOW
+ * Copyright (C) 2025, Risto Kõiva
+ *
+ * License GPL-3.0: https://www.gnu.org/licenses/gpl-3.0.html
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include "crsf_protocol.h"
+
+#define CRSF_RX_RING_SIZE 256 // bytes received from the handset and not parsed yet, a power of two
+
+typedef enum : uint8_t
+{
+    CRSF_RX_INCOMPLETE, // no complete packet in the ring
+    CRSF_RX_SKIPPED,    // a sync byte followed by an impossible length was skipped
+    CRSF_RX_BAD_CRC,    // a packet with a CRC error was dropped
+    CRSF_RX_PACKET      // a packet was taken out of the ring
+} crsfRxResult_e;
+
+/**
+ * @brief Ring buffer of the bytes received from the handset, which are parsed into CRSF packets in place
+ *
+ * The UART is read straight into the ring and the packets are processed where they are, only a packet
+ * wrapping around the end of the ring is copied to be contiguous. Both indices count up freely and
+ * are masked when indexing the ring. Written and parsed from the same task.
+ */
+class CrsfRxRing
+{
+    static_assert((CRSF_RX_RING_SIZE & (CRSF_RX_RING_SIZE - 1)) == 0, "CRSF_RX_RING_SIZE must be a power of two");
+
+public:
+    /**
+     * @brief Contiguous free space at the write position, to read the UART into
+     * @param len receives the number of bytes which fit, 0 if the ring is full
+     */
+    uint8_t *writeBuffer(uint16_t &len)
+    {
+        const uint16_t index = head & MASK;
+        const uint16_t space = CRSF_RX_RING_SIZE - (uint16_t)(head - tail);
+        len = space < CRSF_RX_RING_SIZE - index ? space : CRSF_RX_RING_SIZE - index;
+        return &ring[index];
+    }
+
+    /**
+     * @brief Add len bytes written to writeBuffer()
+     */
+    void written(uint16_t len) { head += len; }
+
+    /**
+     * @return number of bytes not parsed yet
+     */
+    uint16_t size() const { return head - tail; }
+
+    /**
+     * @brief Drop all bytes not parsed yet
+     */
+    void flush() { tail = head; }
+
+    /**
+     * @brief Take the next packet out of the ring, dropping anything in front of its sync byte
+     * @param crc CRC8 of CRSF_CRC_POLY, over [type][payload]
+     * @param packet receives [sync][len][type][payload][crc], valid until the next write
+     * @param len receives the length of the packet
+     * @return CRSF_RX_INCOMPLETE once there is no complete packet left
+     */
+    template <typename Crc>
+    crsfRxResult_e next(const Crc &crc, const uint8_t *&packet, uint8_t &len)
+    {
+        const uint16_t count = skipToSync();
+
+        // Make sure we have at least a packet header and a length byte
+        if (count < 3)
+            return CRSF_RX_INCOMPLETE;
+
+        // Sanity check: A total packet must be at least [sync][len][type][crc] (if no payload) and at most CRSF_MAX_PACKET_LEN
+        const uint8_t totalLen = ring[(tail + 1) & MASK] + 2;
+        if (totalLen < 4 || totalLen > CRSF_MAX_PACKET_LEN)
+        {
+            // Start looking for another packet after this start byte
+            tail++;
+            return CRSF_RX_SKIPPED;
+        }
+
+        // Only proceed once there are enough bytes in the buffer for the entire packet
+        if (count < totalLen)
+            return CRSF_RX_INCOMPLETE;
+
+        // CRC over [type][payload], continued at the start of the ring if the packet wraps around its end
+        const uint16_t start = tail & MASK;
+        const uint16_t crcStart = (start + 2) & MASK;
+        const uint8_t crcLen = totalLen - 3;
+        const uint8_t crcFirstLen = crcLen < CRSF_RX_RING_SIZE - crcStart ? crcLen : CRSF_RX_RING_SIZE - crcStart;
+        uint8_t calculatedCrc = crc.calc(&ring[crcStart], crcFirstLen);
+        calculatedCrc = crc.calc(ring, crcLen - crcFirstLen, calculatedCrc);
+        const bool crcValid = calculatedCrc == ring[(tail + totalLen - 1) & MASK];
+        tail += totalLen;
+        if (!crcValid)
+            return CRSF_RX_BAD_CRC;
+
+        // The packet is processed in place, unless it wraps around the end of the ring
+        packet = &ring[start];
+        if (start + totalLen > CRSF_RX_RING_SIZE)
+        {
+            const uint16_t firstLen = CRSF_RX_RING_SIZE - start;
+            memcpy(linear.asUint8_t, &ring[start], firstLen);
+            memcpy(&linear.asUint8_t[firstLen], ring, totalLen - firstLen);
+            packet = linear.asUint8_t;
+        }
+        len = totalLen;
+        return CRSF_RX_PACKET;
+    }
+
+private:
+    static constexpr uint16_t MASK = CRSF_RX_RING_SIZE - 1;
+
+    /**
+     * Index of the first CRSF_ADDRESS_CRSF_TRANSMITTER or CRSF_SYNC_BYTE in data, len if there is none.
+     * Compares four bytes at a time, a byte of x is zero where the word matches the value.
+     **/
+    static uint16_t ICACHE_RAM_ATTR findSyncByte(const uint8_t *data, uint16_t len)
+    {
+        constexpr uint32_t ONES = 0x01010101UL;
+        constexpr uint32_t HIGHS = 0x80808080UL;
+        uint16_t i = 0;
+        while (i < len && ((uintptr_t)&data[i] & 3) != 0)
+        {
+            if (data[i] == CRSF_ADDRESS_CRSF_TRANSMITTER || data[i] == CRSF_SYNC_BYTE)
+                return i;
+            i++;
+        }
+        for (; i + 4 <= len; i += 4)
+        {
+            const uint32_t word = *(const uint32_t *)&data[i];
+            const uint32_t x1 = word ^ (ONES * CRSF_ADDRESS_CRSF_TRANSMITTER);
+            const uint32_t x2 = word ^ (ONES * CRSF_SYNC_BYTE);
+            if ((((x1 - ONES) & ~x1) | ((x2 - ONES) & ~x2)) & HIGHS)
+                break;
+        }
+        for (; i < len; i++)
+        {
+            if (data[i] == CRSF_ADDRESS_CRSF_TRANSMITTER || data[i] == CRSF_SYNC_BYTE)
+                return i;
+        }
+        return len;
+    }
+
+    /**
+     * Discard the bytes in front of the next header byte, returns the number of bytes left in the ring
+     **/
+    uint16_t skipToSync()
+    {
+        uint16_t count = head - tail;
+        while (count > 0)
+        {
+            const uint16_t index = tail & MASK;
+            const uint16_t len = count < CRSF_RX_RING_SIZE - index ? count : CRSF_RX_RING_SIZE - index;
+            const uint16_t skip = findSyncByte(&ring[index], len);
+            tail += skip;
+            count -= skip;
+            if (skip < len)
+                break; // found, otherwise continue at the start of the ring
+        }
+        return count;
+    }
+
+    alignas(4) uint8_t ring[CRSF_RX_RING_SIZE] = {};
+    inBuffer_U linear = {}; // packets wrapping around the end of the ring are copied here to be processed
+    uint16_t head = 0;      // free running index where the next byte is written
+    uint16_t tail = 0;      // free running index of the next byte to parse
+};
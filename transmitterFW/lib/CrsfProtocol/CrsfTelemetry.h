@@ -0,0 +1,64 @@
+/*
+ * This file belongs to the CyberBrick ESP-NOW transmitter & receiver project, hosted originally at:
+ * https://github.com/rotorman/CyberBrick_ESPNOW
+ * Copyright (C) 2025, Risto Kõiva
+ *
+ * License GPL-3.0: https://www.gnu.org/licenses/gpl-3.0.html
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include "crsf_protocol.h"
+
+#define CRSF_LINK_STATISTICS_FRAME_LEN (CRSF_FRAME_NOT_COUNTED_BYTES + CRSF_FRAME_SIZE(sizeof(crsfLinkStatistics_t)))
+#define CRSF_BATTERY_PAYLOAD_LEN 8 // voltage, current, capacity and remaining
+#define CRSF_BATTERY_FRAME_LEN (CRSF_FRAME_NOT_COUNTED_BYTES + CRSF_FRAME_SIZE(CRSF_BATTERY_PAYLOAD_LEN))
+
+/**
+ * @brief Build a CRSF link statistics frame to the handset
+ * @param crc CRC8 of CRSF_CRC_POLY, over [type][payload]
+ * @param buffer of at least CRSF_LINK_STATISTICS_FRAME_LEN bytes
+ */
+template <class Crc>
+static inline void CrsfMakeLinkStatisticsFrame(const Crc &crc, uint8_t *buffer, const crsfLinkStatistics_t &stats)
+{
+    constexpr uint8_t payloadLen = sizeof(crsfLinkStatistics_t);
+
+    buffer[0] = CRSF_ADDRESS_RADIO_TRANSMITTER;
+    buffer[1] = CRSF_FRAME_SIZE(payloadLen);
+    buffer[2] = CRSF_FRAMETYPE_LINK_STATISTICS;
+    memcpy(&buffer[3], &stats, payloadLen);
+    buffer[payloadLen + 3] = crc.calc(&buffer[2], payloadLen + 1);
+}
+
+/**
+ * @brief Build a CRSF battery sensor frame to the handset, voltage only
+ * @param crc CRC8 of CRSF_CRC_POLY, over [type][payload]
+ * @param buffer of at least CRSF_BATTERY_FRAME_LEN bytes
+ */
+template <class Crc>
+static inline void CrsfMakeBatteryFrame(const Crc &crc, uint8_t *buffer, uint16_t voltageMV)
+{
+    constexpr uint8_t payloadLen = CRSF_BATTERY_PAYLOAD_LEN;
+    const uint16_t voltage = (voltageMV + 50) / 100; // 0.1 V
+
+    buffer[0] = CRSF_ADDRESS_RADIO_TRANSMITTER;
+    buffer[1] = CRSF_FRAME_SIZE(payloadLen);
+    buffer[2] = CRSF_FRAMETYPE_BATTERY_SENSOR;
+    buffer[3] = voltage >> 8; // Big-Endian
+    buffer[4] = voltage;
+    memset(&buffer[5], 0, payloadLen - 2); // current, capacity and remaining are not measured
+    buffer[payloadLen + 3] = crc.calc(&buffer[2], payloadLen + 1);
+}
@@ -31,7 +31,23 @@
 
 #pragma once
 
+#if defined(ARDUINO)
 #include "common.h"
+#else
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+
+// Host stand-in of the ESP32 spinlock for the native tests
+typedef std::atomic_flag portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED ATOMIC_FLAG_INIT
+#define portENTER_CRITICAL(mux) while ((mux)->test_and_set(std::memory_order_acquire)) {}
+#define portEXIT_CRITICAL(mux) (mux)->clear(std::memory_order_release)
+#endif
+
+#ifndef ICACHE_RAM_ATTR
+#define ICACHE_RAM_ATTR
+#endif
 
 /**
  * @brief A FIFO which can be made thread/SMP safe using coarse-grained locking via `lock`/`unlock` methods.
@@ -0,0 +1,231 @@
+/*
+ * This file belongs to the CyberBrick ESP-NOW transmitter & receiver project, hosted originally at:
+ * https://github.com/rotorman/CyberBrick_ESPNOW
+ * Copyright (C) 2025, Risto Kõiva
+ *
+ * License GPL-3.0: https://www.gnu.org/licenses/gpl-3.0.html
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#ifndef ICACHE_RAM_ATTR
+#define ICACHE_RAM_ATTR
+#endif
+
+/**
+ * @brief A FIFO of packets which are built and read in place
+ *
+ * The producer asks for room with reserve(), writes the packet straight into the buffer and queues it
+ * with commit(). The consumer gets the oldest packet with peekContiguous(), e.g. to pass it to
+ * Port.write(), and removes it with release(). Every packet is stored in one piece behind a length
+ * byte. If it does not fit before the end of the buffer, a zero length byte marks the rest as unused
+ * and the packet starts over at the beginning.
+ *
+ * If the FIFO is full, reserve() drops the oldest packets, except the one being read. For packets of
+ * which only the latest matters, dropUnread() before reserve() keeps just that one.
+ *
+ * Not thread safe, the producer and the consumer have to run in the same task.
+ *
+ * @tparam FIFO_SIZE size of the FIFO in bytes, length bytes and unused space at the end included
+ */
+template <uint32_t FIFO_SIZE>
+class PacketFIFO
+{
+    static_assert(FIFO_SIZE > 1 && FIFO_SIZE <= 0x10000, "FIFO_SIZE out of range");
+
+private:
+    uint8_t buffer[FIFO_SIZE] = {0};
+    uint32_t head = 0;        // length byte of the oldest packet
+    uint32_t tail = 0;        // where the next packet goes
+    uint32_t used = 0;        // bytes taken, including the length bytes and the unused end before a wrap
+    uint32_t count = 0;       // packets queued
+    uint32_t reservedAt = 0;  // length byte of the reserved packet
+    uint8_t reservedLen = 0;
+    bool reading = false;     // the oldest packet was handed to the consumer and must stay
+
+    /**
+     * @brief Remove the oldest packet and the unused end which may follow it
+     */
+    ICACHE_RAM_ATTR void dropHead()
+    {
+        const uint32_t len = buffer[head] + 1;
+        count--;
+        used -= len;
+        head += len;
+        if (head == FIFO_SIZE || (used > 0 && buffer[head] == 0))
+        {
+            used -= FIFO_SIZE - head;
+            head = 0;
+        }
+        if (used == 0)
+            head = tail = 0; // the largest room for the next packet
+    }
+
+public:
+    /**
+     * @brief Reserve room for a packet of len bytes, dropping old packets if needed
+     *
+     * Nothing is queued until commit(), reserving again replaces the reservation. The consumer must not
+     * be called in between.
+     *
+     * @return where to write the packet, nullptr if it does not fit
+     */
+    ICACHE_RAM_ATTR uint8_t *reserve(uint8_t len)
+    {
+        const uint32_t need = (uint32_t)len + 1;
+        if (len == 0 || need > FIFO_SIZE)
+            return nullptr;
+
+        for (;;)
+        {
+            if (used == 0)
+            {
+                reservedAt = 0;
+                break;
+            }
+            if (tail > head) // the free space is behind the tail and before the head
+            {
+                if (need <= FIFO_SIZE - tail)
+                {
+                    reservedAt = tail;
+                    break;
+                }
+                if (need <= head)
+                {
+                    reservedAt = 0;
+                    break;
+                }
+            }
+            else if (need <= head - tail) // the free space is between the tail and the head
+            {
+                reservedAt = tail;
+                break;
+            }
+
+            if (reading)
+                return nullptr;
+            dropHead();
+        }
+        reservedLen = len;
+        return &buffer[reservedAt + 1];
+    }
+
+    /**
+     * @brief Queue the packet written to the buffer returned by the last reserve()
+     */
+    ICACHE_RAM_ATTR void commit()
+    {
+        if (reservedLen == 0)
+            return;
+        if (reservedAt != tail)
+        {
+            // The packet starts over at the beginning, mark the rest as unused
+            buffer[tail] = 0;
+            used += FIFO_SIZE - tail;
+        }
+        buffer[reservedAt] = reservedLen;
+        count++;
+        used += reservedLen + 1;
+        tail = reservedAt + reservedLen + 1;
+        if (tail == FIFO_SIZE)
+            tail = 0;
+        reservedLen = 0;
+    }
+
+    /**
+     * @brief Get the oldest packet without removing it, it stays valid until release()
+     *
+     * @param len set to the length of the packet
+     * @return the packet, nullptr if the FIFO is empty
+     */
+    ICACHE_RAM_ATTR const uint8_t *peekContiguous(uint8_t &len)
+    {
+        if (used == 0)
+        {
+            len = 0;
+            return nullptr;
+        }
+        reading = true;
+        len = buffer[head];
+        return &buffer[head + 1];
+    }
+
+    /**
+     * @brief Remove the oldest packet
+     */
+    ICACHE_RAM_ATTR void release()
+    {
+        reading = false;
+        if (used > 0)
+            dropHead();
+    }
+
+    /**
+     * @brief Remove all packets except the one being read
+     *
+     * @return number of packets removed
+     */
+    ICACHE_RAM_ATTR uint32_t dropUnread()
+    {
+        if (!reading)
+        {
+            const uint32_t dropped = count;
+            head = tail = used = count = 0;
+            return dropped;
+        }
+        const uint32_t dropped = count - 1;
+        const uint32_t len = buffer[head] + 1;
+        tail = head + len;
+        if (tail == FIFO_SIZE)
+            tail = 0;
+        used = len;
+        count = 1;
+        return dropped;
+    }
+
+    /**
+     * @return length of the oldest packet, 0 if the FIFO is empty
+     */
+    ICACHE_RAM_ATTR uint8_t frontLength() const
+    {
+        return used == 0 ? 0 : buffer[head];
+    }
+
+    /**
+     * @return number of packets queued
+     */
+    ICACHE_RAM_ATTR uint32_t packets() const
+    {
+        return count;
+    }
+
+    /**
+     * @return number of bytes taken, including the length bytes
+     */
+    ICACHE_RAM_ATTR uint32_t size() const
+    {
+        return used;
+    }
+
+    /**
+     * @brief reset the FIFO back to empty, a pending reservation is discarded
+     */
+    ICACHE_RAM_ATTR void flush()
+    {
+        head = tail = used = count = 0;
+        reservedLen = 0;
+        reading = false;
+    }
+};
@@ -0,0 +1,133 @@
+/*
+ * This file belongs to the CyberBrick ESP-NOW transmitter & receiver project, hosted originally at:
+ * https://github.com/rotorman/CyberBrick_ESPNOW
+ * Copyright (C) 2025, Risto Kõiva
+ *
+ * License GPL-3.0: https://www.gnu.org/licenses/gpl-3.0.html
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
+
+#ifndef ICACHE_RAM_ATTR
+#define ICACHE_RAM_ATTR
+#endif
+
+/**
+ * @brief A lock-free FIFO for exactly one producer and one consumer, which may run on different cores
+ *
+ * Unlike FIFO, it needs no lock() / unlock(), so neither side ever disables interrupts. The producer
+ * only writes tail and the consumer only head, both count up freely and are masked when indexing the
+ * buffer. Publishing an index with release semantics and reading the other side's with acquire
+ * semantics makes the bytes copied before visible to the other side.
+ *
+ * Pushing and popping is all or nothing, nothing is flushed. Only the consumer may call popBytes(),
+ * peek() and skip(), only the producer pushBytes(). size() and free() are safe from both sides, the
+ * value only moves in the caller's favour while it is being used.
+ *
+ * @tparam FIFO_SIZE size of the FIFO in bytes, a power of two
+ */
+template <uint32_t FIFO_SIZE>
+class SPSCFIFO
+{
+    static_assert(FIFO_SIZE > 0 && (FIFO_SIZE & (FIFO_SIZE - 1)) == 0, "FIFO_SIZE must be a power of two");
+
+private:
+    static constexpr uint32_t MASK = FIFO_SIZE - 1;
+
+    uint8_t buffer[FIFO_SIZE] = {0};
+    std::atomic<uint32_t> head {0}; // written by the consumer
+    std::atomic<uint32_t> tail {0}; // written by the producer
+
+public:
+    /**
+     * @brief Push all bytes to the FIFO, nothing is pushed if they do not fit
+     *
+     * @return false if the FIFO has not enough room
+     */
+    ICACHE_RAM_ATTR bool inline pushBytes(const uint8_t *data, uint32_t len)
+    {
+        const uint32_t t = tail.load(std::memory_order_relaxed);
+        if (FIFO_SIZE - (t - head.load(std::memory_order_acquire)) < len)
+            return false;
+
+        const uint32_t index = t & MASK;
+        const uint32_t first = (len < FIFO_SIZE - index) ? len : FIFO_SIZE - index;
+        memcpy(&buffer[index], data, first);
+        memcpy(buffer, data + first, len - first);
+        tail.store(t + len, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Copy the first len bytes out of the FIFO without removing them
+     *
+     * @return false if the FIFO holds fewer bytes
+     */
+    ICACHE_RAM_ATTR bool inline peek(uint8_t *data, uint32_t len) const
+    {
+        const uint32_t h = head.load(std::memory_order_relaxed);
+        if (tail.load(std::memory_order_acquire) - h < len)
+            return false;
+
+        const uint32_t index = h & MASK;
+        const uint32_t first = (len < FIFO_SIZE - index) ? len : FIFO_SIZE - index;
+        memcpy(data, &buffer[index], first);
+        memcpy(data + first, buffer, len - first);
+        return true;
+    }
+
+    /**
+     * @brief Pop len bytes, nothing is popped if the FIFO holds fewer bytes
+     *
+     * @return false if the FIFO holds fewer bytes
+     */
+    ICACHE_RAM_ATTR bool inline popBytes(uint8_t *data, uint32_t len)
+    {
+        if (!peek(data, len))
+            return false;
+        head.store(head.load(std::memory_order_relaxed) + len, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Remove up to len bytes without reading them
+     */
+    ICACHE_RAM_ATTR void inline skip(uint32_t len)
+    {
+        const uint32_t h = head.load(std::memory_order_relaxed);
+        const uint32_t available = tail.load(std::memory_order_acquire) - h;
+        head.store(h + (len < available ? len : available), std::memory_order_release);
+    }
+
+    /**
+     * @return number of bytes in the FIFO
+     */
+    ICACHE_RAM_ATTR uint32_t inline size() const
+    {
+        // head first, it never passes the tail read after it
+        const uint32_t h = head.load(std::memory_order_acquire);
+        return tail.load(std::memory_order_acquire) - h;
+    }
+
+    /**
+     * @return number of bytes free in the FIFO
+     */
+    ICACHE_RAM_ATTR uint32_t inline free() const
+    {
+        return FIFO_SIZE - size();
+    }
+};
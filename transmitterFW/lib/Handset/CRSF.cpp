@@ -22,7 +22,9 @@
 #include "CRSF.h"
 #include "common.h"
 
-GENERIC_CRC8 crsf_crc(CRSF_CRC_POLY);
+CRC_TABLE_ATTR constexpr GENERIC_CRC8<CRSF_CRC_POLY, CRSF_CRC_SLICES> crsf_crc;
+
+crsfLinkStatistics_t CRSF::LinkStatistics = {0};
 
 /***
  * @brief: Convert `version` (string) to a integer version representation
@@ -24,6 +24,10 @@
 
 #include "crsf_protocol.h"
 
+#ifndef CRSF_CRC_SLICES
+#define CRSF_CRC_SLICES 4 // CRSF frames are 10 to 64 bytes long, worth the larger tables
+#endif
+
 extern const char device_name[];
 extern char versionID[];
 
@@ -38,6 +42,6 @@ public:
     static uint32_t VersionStrToU32(const char *verStr);
 };
 
-extern GENERIC_CRC8 crsf_crc;
+extern const GENERIC_CRC8<CRSF_CRC_POLY, CRSF_CRC_SLICES> crsf_crc;
 
 #endif
\ No newline at end of file
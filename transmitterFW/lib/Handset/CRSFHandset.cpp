@@ -21,52 +21,140 @@
 
 #include "CRSF.h"
 #include "CRSFHandset.h"
-#include "FIFO.h"
+#include "PacketFIFO.h"
+#include "OTA.h"
 
+#include <algorithm>
 #include <hal/uart_ll.h>
 #include <soc/soc.h>
 #include <soc/uart_reg.h>
 #include <esp32/rom/gpio.h>
 
 #if (GPIO_PIN_RCSIGNAL_RX_IN == 16) && (GPIO_PIN_RCSIGNAL_TX_OUT == 17)
-HardwareSerial CRSFHandset::Port(1);
+#define HANDSET_UART_NUM 1
 #else
-HardwareSerial CRSFHandset::Port(0);
+#define HANDSET_UART_NUM 0
 #endif
+HardwareSerial CRSFHandset::Port(HANDSET_UART_NUM);
 
 RTC_DATA_ATTR int rtcModelId = 0;
+RTC_DATA_ATTR uint32_t rtcHandsetBaud = 0; // the handset was last connected with this baud rate, 0 if never
+RTC_DATA_ATTR bool rtcHandsetInverted = false;
 
 static constexpr int HANDSET_TELEMETRY_FIFO_SIZE = 128; // this is the smallest telemetry FIFO size in EdgeTX with CRSF defined
 
-/// Out FIFO to buffer messages ///
-static constexpr auto CRSF_SERIAL_OUT_FIFO_SIZE = 256U;
-static FIFO<CRSF_SERIAL_OUT_FIFO_SIZE> SerialOutFIFO;
+/// Out FIFOs to buffer messages, one per priority class ///
+static constexpr auto CRSF_SERIAL_OUT_FIFO_SIZE = 128U;
+static PacketFIFO<CRSF_SERIAL_OUT_FIFO_SIZE> SerialOutFIFO[HANDSET_OUT_CLASS_COUNT];
+// Classes of which only the latest packet matters, the others drop their oldest packets when full
+static constexpr bool outClassCoalesce[HANDSET_OUT_CLASS_COUNT] = {true, true, false, false};
+static handsetOutStats_t outStats[HANDSET_OUT_CLASS_COUNT] = {};
+static handsetOutClass_e reservedClass = HANDSET_OUT_TELEMETRY;
+// The packet being written to the handset, split up over several time-slots if large
+static handsetOutClass_e outClass = HANDSET_OUT_TELEMETRY;
+static const uint8_t *outPacket = nullptr;
+static uint8_t packageLengthRemaining = 0;
+static uint8_t sendingOffset = 0;
+
+static void flushSerialOut()
+{
+    for (auto &fifo : SerialOutFIFO)
+        fifo.flush();
+    outPacket = nullptr;
+    packageLengthRemaining = 0;
+}
+
+static uint32_t queuedOutBytes()
+{
+    uint32_t bytes = 0;
+    for (const auto &fifo : SerialOutFIFO)
+        bytes += fifo.size();
+    return bytes;
+}
+
+static uint8_t *reserveOut(handsetOutClass_e cls, uint8_t len)
+{
+    auto &fifo = SerialOutFIFO[cls];
+    handsetOutStats_t &stats = outStats[cls];
+    if (outClassCoalesce[cls])
+        stats.dropped += fifo.dropUnread();
+    const uint32_t queued = fifo.packets();
+    uint8_t *buf = fifo.reserve(len);
+    stats.dropped += queued - fifo.packets();
+    if (buf == nullptr)
+        stats.dropped++;
+    reservedClass = cls;
+    return buf;
+}
+
+static void commitOut()
+{
+    auto &fifo = SerialOutFIFO[reservedClass];
+    handsetOutStats_t &stats = outStats[reservedClass];
+    fifo.commit();
+    stats.queued++;
+    if (fifo.size() > stats.highWater)
+        stats.highWater = fifo.size();
+}
+
+/**
+ * The highest priority class with a packet, if the packet fits into windowBytes or may be split up.
+ * Lower classes never overtake it, so that none of them starves. HANDSET_OUT_CLASS_COUNT if there
+ * is nothing to send in this window.
+ */
+static handsetOutClass_e nextOutClass(uint8_t windowBytes, bool allowSplit)
+{
+    for (uint8_t cls = 0; cls < HANDSET_OUT_CLASS_COUNT; cls++)
+    {
+        const uint8_t len = SerialOutFIFO[cls].frontLength();
+        if (len == 0)
+            continue;
+        return (len <= windowBytes || allowSplit) ? (handsetOutClass_e)cls : HANDSET_OUT_CLASS_COUNT;
+    }
+    return HANDSET_OUT_CLASS_COUNT;
+}
 
 uint8_t CRSFHandset::modelId = 0; // Initialize the model ID as received from the handset to first model
 bool CRSFHandset::halfDuplex = false;
 
 /// EdgeTX mixer sync ///
 static const int32_t EdgeTXsyncPacketInterval = 200; // in ms
-static const int32_t EdgeTXsyncOffsetSafeMargin = 1000; // 100us
 
 /// UART Handling ///
-static const int32_t TxToHandsetBauds[] = {400000, 115200, 5250000, 3750000, 1870000, 921600, 2250000};
 uint32_t CRSFHandset::UARTrequestedBaud = 5250000;
 
-// for the UART wdt, every 1000ms we change bauds when connect is lost
-static const int UARTwdtInterval = 1000;
+// Half duplex: the window for sending to the handset is sized from the turnarounds measured after
+// connecting, the upper quartile of HALF_DUPLEX_TURNAROUND_SAMPLES of them. The handset's own
+// switching between receiving and sending is not visible here and assumed to take
+// HALF_DUPLEX_HANDSET_TURNAROUND_US.
+static constexpr uint32_t HALF_DUPLEX_HANDSET_TURNAROUND_US = 100;
+static constexpr uint8_t HALF_DUPLEX_MIN_WINDOW_BYTES = 15; // LinkStatistics and EdgeTX sync packets
+
+// The UART driver reports received data once the hardware FIFO holds this many bytes, well before
+// it overflows at 5.25 Mbaud, or when the line was idle for the RX timeout after the end of a packet
+static constexpr uint8_t UART_RX_FIFO_FULL_THRESHOLD = 64; // of the 128 byte hardware FIFO
+static constexpr uint8_t UART_RX_TIMEOUT_SYMBOLS = 1;      // idle time in character times
 
 void CRSFHandset::Begin()
 {
-    UARTwdtLastChecked = millis() + UARTwdtInterval; // allows a delay before the first time the UARTwdt() function is called
-	
     #if not defined(GPIO_PIN_RCSIGNAL_RX_IN) || not defined(GPIO_PIN_RCSIGNAL_TX_OUT)
         #error "GPIO_PIN_RCSIGNAL_RX_IN and GPIO_PIN_RCSIGNAL_TX_OUT must be defined for the RF module to be able to talk to the handset"
     #endif
     halfDuplex = (GPIO_PIN_RCSIGNAL_TX_OUT == GPIO_PIN_RCSIGNAL_RX_IN);
 
-    portDISABLE_INTERRUPTS();
+    const bool warmReset = esp_reset_reason() != ESP_RST_POWERON;
+    const bool cachedBaud = warmReset && IsHandsetBaud(rtcHandsetBaud);
     UARTinverted = halfDuplex; // on a half duplex UART, go with inverted
+    if (cachedBaud)
+    {
+        // Carry on where the handset was before the reset, instead of searching for it again
+        UARTrequestedBaud = rtcHandsetBaud;
+        UARTinverted = rtcHandsetInverted;
+    }
+    baudSearch.begin(millis(), cachedBaud);
+    adjustMaxPacketSize();
+
+    portDISABLE_INTERRUPTS();
     CRSFHandset::Port.begin(UARTrequestedBaud, SERIAL_8N1,
                      GPIO_PIN_RCSIGNAL_RX_IN, GPIO_PIN_RCSIGNAL_TX_OUT,
                      false, 0);
@@ -78,13 +166,56 @@ void CRSFHandset::Begin()
     }
     portENABLE_INTERRUPTS();
     flush_port_input();
-    if (esp_reset_reason() != ESP_RST_POWERON)
+
+    // Parse the packets as soon as they arrive, see waitForInput()
+    inputTask = xTaskGetCurrentTaskHandle();
+    CRSFHandset::Port.setRxFIFOFull(UART_RX_FIFO_FULL_THRESHOLD);
+    CRSFHandset::Port.setRxTimeout(UART_RX_TIMEOUT_SYMBOLS);
+    CRSFHandset::Port.onReceiveError([this](hardwareSerial_error_t error) { onPortReceiveError(error); });
+    CRSFHandset::Port.onReceive([this]() { onPortReceive(); }, false);
+    if (warmReset)
     {
         modelId = rtcModelId;
         if (RecvModelUpdate) RecvModelUpdate();
     }    
 }
 
+/**
+ * Called from the UART driver event task when data was received
+ **/
+void CRSFHandset::onPortReceive()
+{
+    rxEventUS = micros();
+    rxEventPending = true;
+    rxStats.rxEvents++;
+    xTaskNotifyGive(inputTask);
+}
+
+/**
+ * Called from the UART driver event task on receive errors
+ **/
+void CRSFHandset::onPortReceiveError(hardwareSerial_error_t error)
+{
+    if (error == UART_FIFO_OVF_ERROR || error == UART_BUFFER_FULL_ERROR)
+        rxStats.overruns++;
+    else
+        rxStats.rxErrors++;
+}
+
+void CRSFHandset::waitForInput(uint32_t maxWaitMS)
+{
+    // In half-duplex mode, the UART driver wakes us up with its TX done interrupt, so that
+    // handleInput() turns the line around right after the last byte
+    if (transmitting)
+    {
+        uart_wait_tx_done((uart_port_t)HANDSET_UART_NUM, pdMS_TO_TICKS(maxWaitMS));
+        return;
+    }
+    if (CRSFHandset::Port.available() > 0)
+        return;
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(maxWaitMS));
+}
+
 void CRSFHandset::flush_port_input()
 {
     // Make sure there is no garbage on the UART at the start
@@ -96,13 +227,18 @@ void CRSFHandset::flush_port_input()
 
 void CRSFHandset::makeLinkStatisticsPacket(uint8_t *buffer)
 {
-    constexpr uint8_t payloadLen = sizeof(crsfLinkStatistics_t);
+    CrsfMakeLinkStatisticsFrame(crsf_crc, buffer, CRSF::LinkStatistics);
+}
 
-    buffer[0] = CRSF_ADDRESS_RADIO_TRANSMITTER;
-    buffer[1] = CRSF_FRAME_SIZE(payloadLen);
-    buffer[2] = CRSF_FRAMETYPE_LINK_STATISTICS;
-    memcpy(&buffer[3], (uint8_t *)&CRSF::LinkStatistics, payloadLen);
-    buffer[payloadLen + 3] = crsf_crc.calc(&buffer[2], payloadLen + 1);
+void CRSFHandset::makeBatteryPacket(uint8_t *buffer, uint16_t voltageMV)
+{
+    CrsfMakeBatteryFrame(crsf_crc, buffer, voltageMV);
+}
+
+bool CRSFHandset::CanQueueTelemetry(uint8_t len)
+{
+    // The FIFOs hold a length byte in front of each packet, all other classes go out first
+    return controllerConnected && queuedOutBytes() + len + 1 <= maxPeriodBytes;
 }
 
 /**
@@ -111,27 +247,36 @@ void CRSFHandset::makeLinkStatisticsPacket(uint8_t *buffer)
  **/
 void CRSFHandset::packetQueueExtended(uint8_t type, void *data, uint8_t len)
 {
-    uint8_t buf[6] = {
-        (uint8_t)(len + 6),
-        CRSF_ADDRESS_RADIO_TRANSMITTER,
-        (uint8_t)(len + 4),
-        type,
-        CRSF_ADDRESS_RADIO_TRANSMITTER,
-        CRSF_ADDRESS_CRSF_TRANSMITTER
-    };
+    uint8_t *buf = reserveOut(type == CRSF_FRAMETYPE_HANDSET ? HANDSET_OUT_SYNC : HANDSET_OUT_DEVICE_INFO, len + 6);
+    if (buf == nullptr)
+        return;
 
+    buf[0] = CRSF_ADDRESS_RADIO_TRANSMITTER;
+    buf[1] = len + 4;
+    buf[2] = type;
+    buf[3] = CRSF_ADDRESS_RADIO_TRANSMITTER;
+    buf[4] = CRSF_ADDRESS_CRSF_TRANSMITTER;
+    memcpy(&buf[5], data, len);
     // CRC - Starts at type, ends before CRC
-    uint8_t crc = crsf_crc.calc(&buf[3], sizeof(buf)-3);
-    crc = crsf_crc.calc((byte *)data, len, crc);
+    buf[len + 5] = crsf_crc.calc(&buf[2], len + 3);
+    commitOut();
+}
 
-    SerialOutFIFO.lock();
-    if (SerialOutFIFO.ensure(buf[0] + 1))
-    {
-        SerialOutFIFO.pushBytes(buf, sizeof(buf));
-        SerialOutFIFO.pushBytes((byte *)data, len);
-        SerialOutFIFO.push(crc);
-    }
-    SerialOutFIFO.unlock();
+uint8_t *CRSFHandset::reserveTelemetry(uint8_t size, handsetOutClass_e cls)
+{
+    if (!controllerConnected || size > CRSF_MAX_PACKET_LEN)
+        return nullptr;
+    return reserveOut(cls, size);
+}
+
+void CRSFHandset::commitTelemetry()
+{
+    commitOut();
+}
+
+const handsetOutStats_t &CRSFHandset::GetOutStats(handsetOutClass_e cls)
+{
+    return outStats[cls];
 }
 
 void CRSFHandset::sendTelemetryToTX(uint8_t *data)
@@ -146,45 +291,32 @@ void CRSFHandset::sendTelemetryToTX(uint8_t *data)
         }
 
         data[0] = CRSF_ADDRESS_RADIO_TRANSMITTER;
-        SerialOutFIFO.lock();
-        if (SerialOutFIFO.ensure(size + 1))
+        uint8_t *packet = reserveTelemetry(size, data[CRSF_TELEMETRY_TYPE_INDEX] == CRSF_FRAMETYPE_LINK_STATISTICS ? HANDSET_OUT_LINK_STATS : HANDSET_OUT_TELEMETRY);
+        if (packet != nullptr)
         {
-            SerialOutFIFO.push(size); // length
-            SerialOutFIFO.pushBytes(data, size);
+            memcpy(packet, data, size);
+            commitTelemetry();
         }
-        SerialOutFIFO.unlock();
     }
 }
 
-void ICACHE_RAM_ATTR CRSFHandset::JustSentRFpacket()
+void ICACHE_RAM_ATTR CRSFHandset::JustSentRFpacket(uint32_t sentUS)
 {
-    // read them in this order to prevent a potential race condition
-    uint32_t last = dataLastRecv;
-    uint32_t m = micros();
-    auto delta = (int32_t)(m - last);
-
-    if (delta >= (int32_t)RequestedRCpacketIntervalUS)
-    {
-        // missing/late packet, force resync
-        EdgeTXsyncOffset = -(delta % RequestedRCpacketIntervalUS) * 10;
-        EdgeTXsyncWindow = 0;
-        EdgeTXsyncLastSent -= EdgeTXsyncPacketInterval;
-    }
-    else
-    {
-        // The number of packets in the sync window is how many will fit in 20ms.
-        EdgeTXsyncWindow = std::min(EdgeTXsyncWindow + 1, (int32_t)EdgeTXsyncWindowSize);
-        EdgeTXsyncOffset = ((EdgeTXsyncOffset * (EdgeTXsyncWindow-1)) + delta * 10) / EdgeTXsyncWindow;
-    }
+    if (!mixerSyncEnabled)
+        return;
+    // A packet received after sentUS gives a negative delta, which the estimator takes as such
+    mixerSync.addSample((int32_t)(sentUS - RCdataLastRecv), millis());
 }
 
 void CRSFHandset::sendSyncPacketToTX() // in values in us.
 {
     uint32_t now = millis();
-    if (controllerConnected && (now - EdgeTXsyncLastSent) >= EdgeTXsyncPacketInterval)
+    if (controllerConnected && (mixerSync.takeResync() || (now - EdgeTXsyncLastSent) >= EdgeTXsyncPacketInterval))
     {
         int32_t packetRate = RequestedRCpacketIntervalUS * 10; //convert from us to right format
-        int32_t offset = EdgeTXsyncOffset - EdgeTXsyncOffsetSafeMargin; // offset so that opentx always has some headroom
+        // Without mixer sync the packets only repeat the interval, EdgeTX falls back to its own one otherwise
+        int32_t offsetUS = mixerSyncEnabled ? mixerSync.getOffsetUS(EdgeTXsyncPacketInterval * 1000) : 0; // so that EdgeTX always has some headroom
+        int32_t offset = offsetUS * 10;
 
         struct etxSyncData {
             uint8_t subType; // CRSF_HANDSET_SUBCMD_TIMING
@@ -200,46 +332,39 @@ void CRSFHandset::sendSyncPacketToTX() // in values in us.
         sync->offset = htobe32(offset);
 
         packetQueueExtended(CRSF_FRAMETYPE_HANDSET, buffer, sizeof(buffer));
+        mixerSync.correctionSent(offsetUS);
 
         EdgeTXsyncLastSent = now;
     }
 }
 
-void CRSFHandset::RcPacketToChannelsData(bool bExtendedChannels) // data is packed as 11 bits per channel
+void CRSFHandset::RcPacketToChannelsData(const uint8_t *packet, bool bExtendedChannels) // data is packed as 11 bits per channel
 {
-    auto payload = (uint8_t const * const)&inBuffer.asRCPacket_t.channels;
-    constexpr unsigned srcBits = 11;
-    constexpr unsigned dstBits = 11;
-    constexpr unsigned inputChannelMask = (1 << srcBits) - 1;
-    constexpr unsigned precisionShift = dstBits - srcBits;
-
-    // code from BetaFlight rx/crsf.cpp / bitpacker_unpack
-    uint8_t bitsMerged = 0;
-    uint32_t readValue = 0;
-    unsigned readByteIndex = 0;
-    for (uint8_t n=0; n<16; n++)
-    {
-        while (bitsMerged < srcBits)
-        {
-            uint8_t readByte = payload[readByteIndex++];
-            readValue |= ((uint32_t) readByte) << bitsMerged;
-            bitsMerged += 8;
-        }
-        ChannelData[(bExtendedChannels) ? n+16 : n] = (uint16_t)((readValue & inputChannelMask) << precisionShift);
-        readValue >>= srcBits;
-        bitsMerged -= srcBits;
-    }
+    // Same bit order as the OTA frames, channels 17-32 go to the upper half of ChannelData
+    OtaUnpackChannels(&ChannelData[bExtendedChannels ? CRSF_NUM_CHANNELS / 2 : 0], packet + offsetof(rcPacket_t, channels), CRSF_NUM_CHANNELS / 2);
 
     // Call the registered RCdataCallback, if there is one, so it can modify the channel data if it needs to.
     if (RCdataCallback) RCdataCallback();
+
+    // Publish the channels as one set. With extended channels, the set is complete
+    // once the second half has been received.
+    const uint8_t count = channelSet.add(bExtendedChannels);
+    if (count != 0)
+    {
+        channelSnapshot_t &snapshot = ChannelSnapshot.writeBuffer();
+        memcpy(snapshot.ch, ChannelData, sizeof(snapshot.ch));
+        snapshot.count = count;
+        snapshot.recvUS = RCdataLastRecv;
+        ChannelSnapshot.publish();
+        if (ChannelsPublished) ChannelsPublished();
+    }
 }
 
-bool CRSFHandset::processInternalCrsfPackage(uint8_t *package)
+bool CRSFHandset::processInternalCrsfPackage(const uint8_t *package)
 {
     const crsf_ext_header_t *header = (crsf_ext_header_t *)package;
     const crsf_frame_type_e packetType = (crsf_frame_type_e)header->type;
 
-	/*
     // Enter Binding Mode
     if (packetType == CRSF_FRAMETYPE_COMMAND
         && header->frame_size >= 6 // official CRSF is 7 bytes with two CRCs
@@ -251,7 +376,6 @@ bool CRSFHandset::processInternalCrsfPackage(uint8_t *package)
         if (OnBindingCommand) OnBindingCommand();
         return true;
     }
-	*/
 
     if (packetType >= CRSF_FRAMETYPE_DEVICE_PING &&
         (header->dest_addr == CRSF_ADDRESS_CRSF_TRANSMITTER || header->dest_addr == CRSF_ADDRESS_BROADCAST) &&
@@ -263,201 +387,244 @@ bool CRSFHandset::processInternalCrsfPackage(uint8_t *package)
             rtcModelId = modelId;
             if (RecvModelUpdate) RecvModelUpdate();
         }
+        else if (packetType == CRSF_FRAMETYPE_PARAMETER_READ || packetType == CRSF_FRAMETYPE_PARAMETER_WRITE)
+        {
+            if (RecvParameterUpdate) RecvParameterUpdate(packetType, header->payload[0], header->payload[1]);
+        }
         return true;
     }
     return false;
 }
 
-bool CRSFHandset::ProcessPacket()
+bool CRSFHandset::ProcessPacket(const uint8_t *packet)
 {
     bool packetReceived = false;
 
-    CRSFHandset::dataLastRecv = micros();
-
     if (!controllerConnected)
     {
         // CRSF UART Connected
         controllerConnected = true;
+        mixerSync.setInterval(RequestedRCpacketIntervalUS); // the mixer phase is unknown
+        rtcHandsetBaud = UARTrequestedBaud;
+        rtcHandsetInverted = UARTinverted;
         if (connected) connected();
     }
 
-    const uint8_t packetType = inBuffer.asRCPacket_t.header.type;
-    uint8_t *SerialInBuffer = inBuffer.asUint8_t;
+    const uint8_t packetType = ((const crsf_header_t *)packet)->type;
 
     if (packetType == CRSF_FRAMETYPE_RC_CHANNELS_PACKED)
     {
         RCdataLastRecv = micros();
-        RcPacketToChannelsData(false);
+        RcPacketToChannelsData(packet, false);
         packetReceived = true;
     }
     else if (packetType == CRSF_FRAMETYPE_RC_EXTENDED_CHANNELS_PACKED)
     {
         RCdataLastRecv = micros();
-        RcPacketToChannelsData(true);
+        RcPacketToChannelsData(packet, true);
         packetReceived = true;
     }
     // check for all extended frames that are a broadcast or a message to the FC
     else if (packetType >= CRSF_FRAMETYPE_DEVICE_PING &&
-            (SerialInBuffer[3] == CRSF_ADDRESS_FLIGHT_CONTROLLER || SerialInBuffer[3] == CRSF_ADDRESS_BROADCAST || SerialInBuffer[3] == CRSF_ADDRESS_CRSF_RECEIVER))
+            (packet[3] == CRSF_ADDRESS_FLIGHT_CONTROLLER || packet[3] == CRSF_ADDRESS_BROADCAST || packet[3] == CRSF_ADDRESS_CRSF_RECEIVER))
     {
 		if (packetType == CRSF_FRAMETYPE_DEVICE_PING)
 		{
 			// Reply with device information
 			uint8_t deviceInformation[DEVICE_INFORMATION_LENGTH];
-			CRSF::GetDeviceInformation(deviceInformation, 0);
+			CRSF::GetDeviceInformation(deviceInformation, parameterCount);
 			// does append header + crc again so subtract size from length
 			CRSFHandset::packetQueueExtended(CRSF_FRAMETYPE_DEVICE_INFO, deviceInformation + sizeof(crsf_ext_header_t), DEVICE_INFORMATION_PAYLOAD_LENGTH);
 		}
         packetReceived = true;
     }
 
-	packetReceived |= processInternalCrsfPackage(SerialInBuffer);
+	packetReceived |= processInternalCrsfPackage(packet);
     
 	return packetReceived;
 }
 
-void CRSFHandset::alignBufferToSync(uint8_t startIdx)
+/**
+ * Append the bytes received by the UART to rxRing, in two parts when they wrap around its end
+ **/
+void CRSFHandset::readPort()
+{
+    int available = CRSFHandset::Port.available();
+    while (available > 0)
+    {
+        uint16_t space;
+        uint8_t *buffer = rxRing.writeBuffer(space);
+        if (space == 0)
+            break;
+        const uint16_t received = CRSFHandset::Port.readBytes(buffer, std::min(available, (int)space));
+        if (received == 0)
+            break;
+        rxRing.written(received);
+        available -= received;
+    }
+}
+
+/**
+ * Parse the packet at the start of rxRing
+ * @return false if there is no complete packet yet
+ **/
+bool CRSFHandset::parsePacket()
 {
-    uint8_t *SerialInBuffer = inBuffer.asUint8_t;
+    const uint8_t *packet;
+    uint8_t len;
+    switch (rxRing.next(crsf_crc, packet, len))
+    {
+    case CRSF_RX_INCOMPLETE:
+        return false;
+    case CRSF_RX_SKIPPED:
+        return true;
+    case CRSF_RX_BAD_CRC:
+        // UART CRC failure
+        BadPktsCount++;
+        return true;
+    case CRSF_RX_PACKET:
+        break;
+    }
 
-    for (unsigned int i=startIdx ; i<SerialInPacketPtr ; i++)
+    GoodPktsCount++;
+    if (ProcessPacket(packet))
     {
-        // If we find a header byte then move that and trailing bytes to the head of the buffer and let's go!
-        if (SerialInBuffer[i] == CRSF_ADDRESS_CRSF_TRANSMITTER || SerialInBuffer[i] == CRSF_SYNC_BYTE)
+        handleOutput(len);
+        if (RCdataCallback)
         {
-            SerialInPacketPtr -= i;
-            memmove(SerialInBuffer, &SerialInBuffer[i], SerialInPacketPtr);
-            return;
+            RCdataCallback();
         }
     }
-
-    // If no header found then discard this entire buffer
-    SerialInPacketPtr = 0;
+    return true;
 }
 
 void CRSFHandset::handleInput()
 {
-    uint8_t *SerialInBuffer = inBuffer.asUint8_t;
-	
 	if (UARTwdt())
     {
         return;
     }
+
+    if (rxEventPending)
+    {
+        rxEventPending = false;
+        const uint32_t latency = micros() - rxEventUS;
+        rxStats.lastLatencyUS = latency;
+        rxStats.sumLatencyUS += latency;
+        rxStats.latencyCount++;
+        if (latency > rxStats.maxLatencyUS)
+            rxStats.maxLatencyUS = latency;
+    }
 	
     if (transmitting)
     {
         // if currently transmitting in half-duplex mode then check if the TX buffers are empty.
         // If there is still data in the transmit buffers then exit, and we'll check next go round.
-        if (!uart_ll_is_tx_idle(UART_LL_GET_HW(0)))
+        if (!uart_ll_is_tx_idle(UART_LL_GET_HW(HANDSET_UART_NUM)))
         {
             return;
         }
         // All done transmitting; go back to receive mode
         transmitting = false;
         duplex_set_RX();
+        recordTurnaround();
         flush_port_input();
     }
 
-    // Add new data, and then discard bytes until we start with header byte
-    auto toRead = std::min(CRSFHandset::Port.available(), CRSF_MAX_PACKET_LEN - SerialInPacketPtr);
-    SerialInPacketPtr += CRSFHandset::Port.readBytes(&SerialInBuffer[SerialInPacketPtr], toRead);
-    alignBufferToSync(0);
-
-    // Make sure we have at least a packet header and a length byte
-    if (SerialInPacketPtr < 3)
-        return;
+    readPort();
 
-    // Sanity check: A total packet must be at least [sync][len][type][crc] (if no payload) and at most CRSF_MAX_PACKET_LEN
-    const uint32_t totalLen = SerialInBuffer[1] + 2;
-    if (totalLen < 4 || totalLen > CRSF_MAX_PACKET_LEN)
+    // Process every complete packet, e.g. both halves of the extended channels arriving back to back.
+    // In half-duplex mode, the rest waits until the reply to the handset has been sent.
+    while (!transmitting && parsePacket())
     {
-        // Start looking for another packet after this start byte
-        alignBufferToSync(1);
-        return;
     }
-
-    // Only proceed one there are enough bytes in the buffer for the entire packet
-    if (SerialInPacketPtr < totalLen)
-        return;
-
-    uint8_t CalculatedCRC = crsf_crc.calc(&SerialInBuffer[2], totalLen - 3);
-    if (CalculatedCRC == SerialInBuffer[totalLen - 1])
-    {
-        GoodPktsCount++;
-        if (ProcessPacket())
-        {
-            handleOutput(totalLen);
-            if (RCdataCallback)
-            {
-                RCdataCallback();
-            }
-        }
-    }
-    else
-    {
-        // UART CRC failure
-        BadPktsCount++;
-    }
-
-    SerialInPacketPtr -= totalLen;
-    memmove(SerialInBuffer, &SerialInBuffer[totalLen], SerialInPacketPtr);
 }
 
 void CRSFHandset::handleOutput(int receivedBytes)
 {
-    static uint8_t CRSFoutBuffer[CRSF_MAX_PACKET_LEN] = {0};
-    // both static to split up larger packages
-    static uint8_t packageLengthRemaining = 0;
-    static uint8_t sendingOffset = 0;
-
     if (!controllerConnected)
     {
-        SerialOutFIFO.lock();
-        SerialOutFIFO.flush();
-        SerialOutFIFO.unlock();
+        flushSerialOut();
         return;
     }
 
-    if (packageLengthRemaining == 0 && SerialOutFIFO.size() == 0)
-    {
-        sendSyncPacketToTX(); // calculate mixer sync packet if needed
-    }
+    // The sync has its own class and goes out first, no matter how much telemetry is waiting
+    sendSyncPacketToTX(); // calculate mixer sync packet if needed
 
-    // if partial package remaining, or data in the output FIFO that needs to be written
-    if (packageLengthRemaining > 0 || SerialOutFIFO.size() > 0) {
+    // if partial package remaining, or data in the output FIFOs that needs to be written
+    if (packageLengthRemaining > 0 || queuedOutBytes() > 0) {
         uint8_t periodBytesRemaining = HANDSET_TELEMETRY_FIFO_SIZE;
         if (halfDuplex)
         {
             periodBytesRemaining = std::min((maxPeriodBytes - receivedBytes % maxPeriodBytes), (int)maxPacketBytes);
             periodBytesRemaining = std::max(periodBytesRemaining, (uint8_t)10);
-            if (!transmitting)
-            {
-                transmitting = true;
-                duplex_set_TX();
-            }
         }
 
+        const uint8_t windowBytes = periodBytesRemaining;
         do
         {
-            SerialOutFIFO.lock();
-            // no package is in transit so get new data from the fifo
+            // no package is in transit so get new data from the fifos, it stays there until written.
+            // A packet not fitting into the rest of the window waits for the next one, unless the
+            // window is still empty.
             if (packageLengthRemaining == 0)
             {
-                packageLengthRemaining = SerialOutFIFO.pop();
-                SerialOutFIFO.popBytes(CRSFoutBuffer, packageLengthRemaining);
+                outClass = nextOutClass(periodBytesRemaining, periodBytesRemaining == windowBytes);
+                if (outClass == HANDSET_OUT_CLASS_COUNT)
+                    break;
+                outPacket = SerialOutFIFO[outClass].peekContiguous(packageLengthRemaining);
                 sendingOffset = 0;
             }
-            SerialOutFIFO.unlock();
+
+            // Half duplex: only take the line over once there is something to send in this window
+            if (halfDuplex && !transmitting)
+            {
+                transmitting = true;
+                duplex_set_TX();
+                txStartUS = micros();
+                txBytes = 0;
+            }
 
             // if the package is long we need to split it, so it fits in the sending interval
             uint8_t writeLength = std::min(packageLengthRemaining, periodBytesRemaining);
 
             // write the packet out, if it's a large package the offset holds the starting position
-            CRSFHandset::Port.write(CRSFoutBuffer + sendingOffset, writeLength);
+            CRSFHandset::Port.write(outPacket + sendingOffset, writeLength);
             sendingOffset += writeLength;
             packageLengthRemaining -= writeLength;
             periodBytesRemaining -= writeLength;
-        } while(periodBytesRemaining != 0 && SerialOutFIFO.size() != 0);
+            txBytes += writeLength;
+            if (packageLengthRemaining == 0)
+                SerialOutFIFO[outClass].release();
+        } while(periodBytesRemaining != 0 && queuedOutBytes() != 0);
+    }
+}
+
+/**
+ * Half duplex: record the time the line was not usable in the last transmission window, from the
+ * handset packet to sending and from the last byte sent to receiving again
+ **/
+void CRSFHandset::recordTurnaround()
+{
+    const uint32_t now = micros();
+    const uint32_t sendUS = (uint64_t)txBytes * 10 * 1000000 / UARTrequestedBaud; // 10 bits per byte
+    const int32_t turnaround = (int32_t)(txStartUS - rxEventUS) + (int32_t)(now - txStartUS - sendUS);
+    const uint32_t turnaroundUS = turnaround > 0 ? turnaround : 0;
+
+    rxStats.turnarounds++;
+    rxStats.lastTurnaroundUS = turnaroundUS;
+    if (turnaroundUS > rxStats.maxTurnaroundUS)
+        rxStats.maxTurnaroundUS = turnaroundUS;
+
+    // Only the first ones after connecting size the window, so that the Lua chunk size stays put
+    if (turnaroundSamples < HALF_DUPLEX_TURNAROUND_SAMPLES)
+    {
+        turnaroundSampleUS[turnaroundSamples++] = turnaroundUS;
+        if (turnaroundSamples == HALF_DUPLEX_TURNAROUND_SAMPLES)
+        {
+            std::sort(turnaroundSampleUS, turnaroundSampleUS + HALF_DUPLEX_TURNAROUND_SAMPLES);
+            turnaroundBudgetUS = turnaroundSampleUS[HALF_DUPLEX_TURNAROUND_SAMPLES * 3 / 4];
+            adjustMaxPacketSize();
+        }
     }
 }
 
@@ -517,6 +684,15 @@ int CRSFHandset::getMinPacketInterval() const
     return 1;   // 1-million Hz!
 }
 
+void CRSFHandset::setPacketInterval(int32_t PacketInterval)
+{
+    RequestedRCpacketIntervalUS = PacketInterval;
+    mixerSync.setInterval(RequestedRCpacketIntervalUS);
+    // Let EdgeTX know about the new rate with the next sync packet
+    EdgeTXsyncLastSent -= EdgeTXsyncPacketInterval;
+    adjustMaxPacketSize();
+}
+
 void ICACHE_RAM_ATTR CRSFHandset::adjustMaxPacketSize()
 {
     const int LUA_CHUNK_QUERY_SIZE = 26;
@@ -527,59 +703,41 @@ void ICACHE_RAM_ATTR CRSFHandset::adjustMaxPacketSize()
     // which switching direction. It also appears that the absolute minimum packet size should be 15 bytes as this will fit
     // the LinkStatistics and OpenTX sync packets.
     maxPeriodBytes = std::min((int)(UARTrequestedBaud / 10 / (1000000/RequestedRCpacketIntervalUS) * 87 / 100), HANDSET_TELEMETRY_FIFO_SIZE);
+    if (halfDuplex && turnaroundSamples == HALF_DUPLEX_TURNAROUND_SAMPLES)
+    {
+        // Once measured, the period less the turnarounds on both sides instead of the 87%. Slow turnarounds
+        // do not shrink it below a chunk query of the handset and the smallest window after it.
+        const int32_t usableUS = RequestedRCpacketIntervalUS - (int32_t)(turnaroundBudgetUS + HALF_DUPLEX_HANDSET_TURNAROUND_US);
+        const uint64_t usableBytes = usableUS > 0 ? (uint64_t)usableUS * (UARTrequestedBaud / 10) / 1000000 : 0;
+        maxPeriodBytes = std::max(std::min(usableBytes, (uint64_t)HANDSET_TELEMETRY_FIFO_SIZE), (uint64_t)(LUA_CHUNK_QUERY_SIZE + HALF_DUPLEX_MIN_WINDOW_BYTES));
+    }
     // Maximum number of bytes we can send in a single window, half the period bytes, upto one full CRSF packet.
-    maxPacketBytes = std::min(maxPeriodBytes - max(maxPeriodBytes / 2, LUA_CHUNK_QUERY_SIZE), CRSF_MAX_PACKET_LEN);
+    // A period too short for the chunk query leaves no room at all.
+    const int packetBytes = (int)maxPeriodBytes - std::max(maxPeriodBytes / 2, LUA_CHUNK_QUERY_SIZE);
+    maxPacketBytes = std::max(std::min(packetBytes, (int)CRSF_MAX_PACKET_LEN), 0);
 }
 
 uint32_t CRSFHandset::autobaud()
 {
-    static enum { INIT, MEASURED, INVERTED } state;
-
-    if (state == MEASURED) {
-        UARTinverted = !UARTinverted;
-        state = INVERTED;
-        return UARTrequestedBaud;
-    }
-    if (state == INVERTED) {
-        UARTinverted = !UARTinverted;
-        state = INIT;
-    }
-
-    if (REG_GET_BIT(UART_AUTOBAUD_REG(0), UART_AUTOBAUD_EN) == 0) {
+    autobaudUnit_t unit;
+    unit.enabled = REG_GET_BIT(UART_AUTOBAUD_REG(0), UART_AUTOBAUD_EN) != 0;
+    unit.edges = REG_READ(UART_RXD_CNT_REG(0));
+    unit.lowPulse = REG_READ(UART_LOWPULSE_REG(0));
+    unit.highPulse = REG_READ(UART_HIGHPULSE_REG(0));
+
+    autobaudAction_e action;
+    const uint32_t baud = baudSearch.next(unit, halfDuplex, UARTinverted, UARTrequestedBaud, action);
+    if (action == AUTOBAUD_START)
         REG_WRITE(UART_AUTOBAUD_REG(0), 4 << UART_GLITCH_FILT_S | UART_AUTOBAUD_EN);    // enable, glitch filter 4
-        return 400000;
-    }
-    if (REG_GET_BIT(UART_AUTOBAUD_REG(0), UART_AUTOBAUD_EN) && REG_READ(UART_RXD_CNT_REG(0)) < 300)
-    {
-        return 400000;
-    }
-
-    state = MEASURED;
-
-    auto low_period  = (int32_t)REG_READ(UART_LOWPULSE_REG(0));
-    auto high_period = (int32_t)REG_READ(UART_HIGHPULSE_REG(0));
-    REG_CLR_BIT(UART_AUTOBAUD_REG(0), UART_AUTOBAUD_EN);   // disable autobaud
-
-    // sample code at https://github.com/espressif/esp-idf/issues/3336
-    // says baud rate = 80000000/min(UART_LOWPULSE_REG, UART_HIGHPULSE_REG);
-    // Based on testing use max and add 2 for lowest deviation
-    int32_t calculatedBaud = 80000000 / (max(low_period, high_period) + 3);
-    auto bestBaud = TxToHandsetBauds[0];
-    for(int TxToHandsetBaud : TxToHandsetBauds)
-    {
-        if (abs(calculatedBaud - bestBaud) > abs(calculatedBaud - (int32_t)TxToHandsetBaud))
-        {
-            bestBaud = (int32_t)TxToHandsetBaud;
-        }
-    }
-    return bestBaud;
+    else if (action == AUTOBAUD_STOP)
+        REG_CLR_BIT(UART_AUTOBAUD_REG(0), UART_AUTOBAUD_EN);   // disable autobaud
+    return baud;
 }
 
 bool CRSFHandset::UARTwdt()
 {
     bool retval = false;
-    uint32_t now = millis();
-    if (now - UARTwdtLastChecked > UARTwdtInterval)
+    if (baudSearch.check(millis(), controllerConnected, RequestedRCpacketIntervalUS))
     {
         // If no packets or more bad than good packets, rate cycle/autobaud the UART but
         // do not adjust the parameters while in wifi mode. If a firmware is being
@@ -590,14 +748,16 @@ bool CRSFHandset::UARTwdt()
             {
                 if (disconnected) disconnected();
                 controllerConnected = false;
+                channelSet.reset();
             }
 
             UARTrequestedBaud = autobaud();
             if (UARTrequestedBaud != 0)
             {
+                turnaroundSamples = 0; // measure again at the new baud rate
                 adjustMaxPacketSize();
 
-                SerialOutFIFO.flush();
+                flushSerialOut();
                 CRSFHandset::Port.flush();
                 CRSFHandset::Port.updateBaudRate(UARTrequestedBaud);
                 if (halfDuplex)
@@ -606,17 +766,11 @@ bool CRSFHandset::UARTwdt()
                 }
                 // cleanup input buffer
                 flush_port_input();
+                rxRing.flush();
             }
             retval = true;
         }
 
-        UARTwdtLastChecked = now;
-        if (retval)
-        {
-            // Speed up the cycling
-            UARTwdtLastChecked -= 3 * (UARTwdtInterval >> 2);
-        }
-
         BadPktsCount = 0;
         GoodPktsCount = 0;
     }
@@ -22,10 +22,50 @@
 #pragma once
 
 #include "crsf_protocol.h"
+#include "CrsfChannelSet.h"
+#include "CrsfRxRing.h"
+#include "CrsfTelemetry.h"
+#include "HandsetBaud.h"
 #include "HardwareSerial.h"
 #include "common.h"
+#include "MixerSync.h"
 #include "driver/uart.h"
 
+#define HALF_DUPLEX_TURNAROUND_SAMPLES 16 // turnarounds measured after connecting to size the send window
+
+// Receive path statistics of the handset UART, all times in microseconds
+typedef struct
+{
+    uint32_t rxEvents;      // receive notifications from the UART driver
+    uint32_t overruns;      // UART FIFO or driver buffer overflows, received bytes were lost
+    uint32_t rxErrors;      // framing, parity and break errors
+    uint32_t lastLatencyUS; // receive notification to parsing in handleInput()
+    uint32_t maxLatencyUS;
+    uint64_t sumLatencyUS;  // average is sumLatencyUS / latencyCount
+    uint32_t latencyCount;
+    uint32_t turnarounds;      // half duplex: windows sent to the handset
+    uint32_t lastTurnaroundUS; // half duplex: line time lost switching to sending and back to receiving
+    uint32_t maxTurnaroundUS;
+} handsetRxStats_t;
+
+// Priority classes of the packets sent to the handset, highest first
+typedef enum : uint8_t
+{
+    HANDSET_OUT_SYNC,        // EdgeTX mixer sync, only the latest is kept
+    HANDSET_OUT_LINK_STATS,  // link statistics, only the latest is kept
+    HANDSET_OUT_DEVICE_INFO, // device information and Lua parameters, the oldest are dropped when full
+    HANDSET_OUT_TELEMETRY,   // other telemetry, the oldest are dropped when full
+    HANDSET_OUT_CLASS_COUNT
+} handsetOutClass_e;
+
+// Output queue statistics of a priority class
+typedef struct
+{
+    uint32_t queued;    // packets queued
+    uint32_t dropped;   // packets dropped or replaced by a newer one before they were sent
+    uint32_t highWater; // most bytes queued at once, including a length byte per packet
+} handsetOutStats_t;
+
 class CRSFHandset final
 {
 public:
@@ -40,6 +80,12 @@ public:
      */
     void setRCDataCallback(void (*callback)()) { RCdataCallback = callback; }
 
+    /**
+     * @brief register a function to be called when a complete channel set has been published to ChannelSnapshot
+     * @param callback
+     */
+    void setChannelsPublishedCallback(void (*callback)()) { ChannelsPublished = callback; }
+
     /**
      * Register callback functions for state information about the connection or handset
      * @param connectedCallback called when the protocol detects a stable connection to the handset
@@ -53,11 +99,40 @@ public:
         RecvModelUpdate = RecvModelUpdateCallback;
     }
 
+    /**
+     * @brief register a function to be called when the handset sends the bind command, e.g. from the
+     * [Bind] button in the EdgeTX model setup
+     * @param callback
+     */
+    void setBindingCallback(void (*callback)()) { OnBindingCommand = callback; }
+
+    /**
+     * @brief register a function to be called when the handset reads or writes a (Lua) parameter
+     * @param callback called with the frame type, the parameter id and the chunk number or new value
+     * @param count the number of parameters, reported to the handset in the device information
+     */
+    void registerParameterCallback(void (*callback)(uint8_t type, uint8_t fieldId, uint8_t arg), uint8_t count)
+    {
+        RecvParameterUpdate = callback;
+        parameterCount = count;
+    }
+
     /**
      * @brief Process any pending input data from the CRSF handset
      */
     void handleInput();
 
+    /**
+     * @brief Block the calling task until the UART driver reports received data, or at most maxWaitMS.
+     * Returns right away if there is more data to process. Must be called from the task which called Begin().
+     */
+    void waitForInput(uint32_t maxWaitMS);
+
+    /**
+     * @return the receive path statistics, updated from the UART driver event task
+     */
+    const volatile handsetRxStats_t &GetRxStats() const { return rxStats; }
+
 	void handleOutput(int receivedBytes);
 
 	static HardwareSerial Port;
@@ -66,6 +141,17 @@ public:
 	
     static void makeLinkStatisticsPacket(uint8_t *buffer);
 
+    /**
+     * @brief Build a CRSF battery sensor packet, voltage only
+     * @param buffer of at least CRSF_BATTERY_FRAME_LEN bytes
+     */
+    static void makeBatteryPacket(uint8_t *buffer, uint16_t voltageMV);
+
+    /**
+     * @return true if a telemetry packet of len bytes can be queued and still be sent within one handset time-slot
+     */
+    bool CanQueueTelemetry(uint8_t len);
+
     static void packetQueueExtended(uint8_t type, void *data, uint8_t len);
 	
     /**
@@ -80,11 +166,29 @@ public:
      */
     int getMinPacketInterval() const;
 
+    /**
+     * @brief Set the interval between RC packets requested from the handset via the EdgeTX mixer sync
+     * @param PacketInterval in microseconds, not below getMinPacketInterval()
+     */
+    void setPacketInterval(int32_t PacketInterval);
+
     /**
      * @brief Called to indicate to the protocol that a packet has just been sent over-the-air
      * This is used to synchronise the packets from the handset to the OTA protocol to minimise latency
+     * @param sentUS micros() when the packet was handed to the radio, not when it was acknowledged
+     */
+    void JustSentRFpacket(uint32_t sentUS);
+
+    /**
+     * @brief Leave the EdgeTX mixer where it is, for when the RF frames are sent right on the handset frames and
+     * their phase to them is always zero. The sync packets then only carry the packet interval.
+     */
+    void disableMixerSync() { mixerSyncEnabled = false; }
+
+    /**
+     * @return the EdgeTX mixer sync statistics, including the phase jitter and the time the mixer took to align
      */
-    void JustSentRFpacket();
+    const mixerSyncStats_t &GetSyncStats() const { return mixerSync.getStats(); }
 
     /**
      * Send a telemetry packet back to the handset
@@ -92,6 +196,24 @@ public:
      */
 	void sendTelemetryToTX(uint8_t *data);
 
+    /**
+     * @brief Reserve room for a telemetry packet in the output queue, to build it in place
+     * @param size of the complete CRSF packet in bytes
+     * @param cls priority class of the packet
+     * @return where to build the packet, nullptr if the handset is not connected or the packet does not fit
+     */
+    uint8_t *reserveTelemetry(uint8_t size, handsetOutClass_e cls = HANDSET_OUT_TELEMETRY);
+
+    /**
+     * @brief Send the packet built in the room returned by the last reserveTelemetry()
+     */
+    void commitTelemetry();
+
+    /**
+     * @return the output queue statistics of a priority class
+     */
+    static const handsetOutStats_t &GetOutStats(handsetOutClass_e cls);
+
     static uint8_t getModelID() { return modelId; }
 
     /**
@@ -99,35 +221,50 @@ public:
      */
     uint32_t GetRCdataLastRecv() const { return RCdataLastRecv; }
 
+    /**
+     * @return true if the handset sends the extended channels 17-32 in addition to channels 1-16
+     */
+    bool HasExtendedChannels() const { return channelSet.isExtended(); }
+
 	static uint32_t GetCurrentBaudRate() { return UARTrequestedBaud; }
     static bool isHalfDuplex() { return halfDuplex; }
 	
 private:
     bool controllerConnected = false;
     void (*RCdataCallback)() = nullptr;  // called when there is new RC data
+    void (*ChannelsPublished)() = nullptr; // called when a complete channel set was published
     void (*disconnected)() = nullptr;    // called when RC packet stream is lost
     void (*connected)() = nullptr;       // called when RC packet stream is regained
     void (*RecvModelUpdate)() = nullptr; // called when model id changes, ie command from Radio
+    void (*RecvParameterUpdate)(uint8_t type, uint8_t fieldId, uint8_t arg) = nullptr; // called on Lua parameter read/write
+    void (*OnBindingCommand)() = nullptr; // called when the handset requests binding
+    uint8_t parameterCount = 0;
 
     volatile uint32_t RCdataLastRecv = 0;
-    int32_t RequestedRCpacketIntervalUS = RF_FRAME_RATE_US;
-
-    inBuffer_U inBuffer = {};
+    CrsfChannelSet channelSet;
+    volatile int32_t RequestedRCpacketIntervalUS = RF_FRAME_RATE_US;
 
     /// EdgeTX mixer sync ///
-    volatile uint32_t dataLastRecv = 0;
-    volatile int32_t EdgeTXsyncOffset = 0;
-    volatile int32_t EdgeTXsyncWindow = 0;
-    volatile int32_t EdgeTXsyncWindowSize = 1;
+    MixerSync mixerSync;
+    bool mixerSyncEnabled = true;
     uint32_t EdgeTXsyncLastSent = 0;
 
     /// UART Handling ///
-    uint8_t SerialInPacketPtr = 0; // index where we are reading/writing
+    TaskHandle_t inputTask = nullptr;     // task calling handleInput(), woken up by the UART driver
+    volatile uint32_t rxEventUS = 0;      // micros() of the last receive notification
+    volatile bool rxEventPending = false; // notification not yet followed by handleInput()
+    volatile handsetRxStats_t rxStats = {};
+    CrsfRxRing rxRing;
     static bool halfDuplex;
     bool transmitting = false;
+    uint32_t txStartUS = 0;    // micros() when switched to sending
+    uint16_t txBytes = 0;      // bytes sent since
+    uint8_t turnaroundSamples = 0;
+    uint32_t turnaroundSampleUS[HALF_DUPLEX_TURNAROUND_SAMPLES] = {};
+    uint32_t turnaroundBudgetUS = 0;
     uint32_t GoodPktsCount = 0;
     uint32_t BadPktsCount = 0;
-    uint32_t UARTwdtLastChecked = 0;
+    HandsetBaud baudSearch;
     uint8_t maxPacketBytes = CRSF_MAX_PACKET_LEN;
     uint8_t maxPeriodBytes = CRSF_MAX_PACKET_LEN;
 
@@ -137,11 +274,15 @@ private:
     void adjustMaxPacketSize();
     void duplex_set_RX() const;
     void duplex_set_TX() const;
-    void RcPacketToChannelsData(bool bExtendedChannels);
-    bool processInternalCrsfPackage(uint8_t *package);
-    void alignBufferToSync(uint8_t startIdx);
-    bool ProcessPacket();
+    void RcPacketToChannelsData(const uint8_t *packet, bool bExtendedChannels);
+    bool processInternalCrsfPackage(const uint8_t *package);
+    void readPort();
+    bool parsePacket();
+    bool ProcessPacket(const uint8_t *packet);
     bool UARTwdt();
+    void recordTurnaround();
+    void onPortReceive();
+    void onPortReceiveError(hardwareSerial_error_t error);
     uint32_t autobaud();	
     void flush_port_input();
 };
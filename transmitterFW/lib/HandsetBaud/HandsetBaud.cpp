@@ -0,0 +1,102 @@
+/*
+ * This file belongs to the CyberBrick ESP-NOW transmitter & receiver project, hosted originally at:
+ * https://github.com/rotorman/CyberBrick_ESPNOW
+ * Copyright (C) 2025, Risto Kõiva
+ *
+ * License GPL-3.0: https://www.gnu.org/licenses/gpl-3.0.html
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "HandsetBaud.h"
+
+#include <stdlib.h>
+
+const int32_t TxToHandsetBauds[HANDSET_BAUD_COUNT] = {400000, 115200, 5250000, 3750000, 1870000, 921600, 2250000};
+
+bool IsHandsetBaud(uint32_t baud)
+{
+    for (int32_t TxToHandsetBaud : TxToHandsetBauds)
+    {
+        if (baud == (uint32_t)TxToHandsetBaud)
+            return true;
+    }
+    return false;
+}
+
+int32_t NearestHandsetBaud(uint32_t lowPulse, uint32_t highPulse)
+{
+    // sample code at https://github.com/espressif/esp-idf/issues/3336
+    // says baud rate = 80000000/min(UART_LOWPULSE_REG, UART_HIGHPULSE_REG);
+    // Based on testing use max and add 2 for lowest deviation
+    const int32_t calculatedBaud = 80000000 / ((int32_t)(lowPulse > highPulse ? lowPulse : highPulse) + 3);
+    int32_t bestBaud = TxToHandsetBauds[0];
+    for (int32_t TxToHandsetBaud : TxToHandsetBauds)
+    {
+        if (abs(calculatedBaud - bestBaud) > abs(calculatedBaud - TxToHandsetBaud))
+        {
+            bestBaud = TxToHandsetBaud;
+        }
+    }
+    return bestBaud;
+}
+
+uint32_t HandsetBaud::interval(bool connected, uint32_t rcIntervalUS)
+{
+    // Searching, the autobaud unit is polled until it has seen enough edges, so that the baud rate is
+    // found within one measurement window. Connected, the interval follows the RC packet rate.
+    if (!connected)
+        return HANDSET_BAUD_LOCK_INTERVAL_MS;
+    const uint32_t intervalMS = rcIntervalUS * HANDSET_BAUD_LOST_PACKETS / 1000;
+    if (intervalMS < HANDSET_BAUD_MIN_INTERVAL_MS)
+        return HANDSET_BAUD_MIN_INTERVAL_MS;
+    if (intervalMS > HANDSET_BAUD_MAX_INTERVAL_MS)
+        return HANDSET_BAUD_MAX_INTERVAL_MS;
+    return intervalMS;
+}
+
+bool HandsetBaud::check(uint32_t nowMS, bool connected, uint32_t rcIntervalUS)
+{
+    if (nowMS - lastCheckedMS <= interval(connected || grace, rcIntervalUS))
+        return false;
+    lastCheckedMS = nowMS;
+    grace = false;
+    return true;
+}
+
+uint32_t HandsetBaud::next(const autobaudUnit_t &unit, bool halfDuplex, bool &inverted, uint32_t currentBaud, autobaudAction_e &action)
+{
+    action = AUTOBAUD_KEEP;
+
+    // Only a half duplex UART can be inverted, a full duplex one goes straight back to measuring
+    if (state == MEASURED && halfDuplex) {
+        inverted = !inverted;
+        state = INVERTED;
+        return currentBaud;
+    }
+    if (state == INVERTED) {
+        inverted = !inverted;
+        state = INIT;
+    }
+
+    if (!unit.enabled) {
+        action = AUTOBAUD_START;
+        return HANDSET_AUTOBAUD_BAUD;
+    }
+    if (unit.edges < HANDSET_AUTOBAUD_MIN_EDGES)
+    {
+        return HANDSET_AUTOBAUD_BAUD;
+    }
+
+    state = MEASURED;
+    action = AUTOBAUD_STOP;
+    return NearestHandsetBaud(unit.lowPulse, unit.highPulse);
+}
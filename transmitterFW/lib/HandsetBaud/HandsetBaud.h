@@ -0,0 +1,112 @@
+/*
+ * This file belongs to the CyberBrick ESP-NOW transmitter & receiver project, hosted originally at:
+ * https://github.com/rotorman/CyberBrick_ESPNOW
+ * Copyright (C) 2025, Risto Kõiva
+ *
+ * License GPL-3.0: https://www.gnu.org/licenses/gpl-3.0.html
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#define HANDSET_BAUD_COUNT 7
+
+// While searching for the handset, the baud rate is checked every HANDSET_BAUD_LOCK_INTERVAL_MS,
+// which at the lowest packet rate of 50 Hz covers at least two frames. Once connected, the connection
+// is lost if more bad than good packets arrive within HANDSET_BAUD_LOST_PACKETS RC packet intervals.
+#define HANDSET_BAUD_LOCK_INTERVAL_MS 50
+#define HANDSET_BAUD_LOST_PACKETS 25
+#define HANDSET_BAUD_MIN_INTERVAL_MS 100
+#define HANDSET_BAUD_MAX_INTERVAL_MS 1000
+#define HANDSET_AUTOBAUD_MIN_EDGES 300 // edges the autobaud unit has to see before its pulse widths are used, about three CRSF frames
+#define HANDSET_AUTOBAUD_BAUD 400000   // the UART listens at this baud rate while the autobaud unit measures
+
+extern const int32_t TxToHandsetBauds[HANDSET_BAUD_COUNT];
+
+/**
+ * @return true if baud is one of TxToHandsetBauds
+ */
+bool IsHandsetBaud(uint32_t baud);
+
+/**
+ * @brief The handset baud rate closest to the shortest pulses measured by the autobaud unit
+ * @param lowPulse shortest low pulse, in APB clock cycles
+ * @param highPulse shortest high pulse, in APB clock cycles
+ */
+int32_t NearestHandsetBaud(uint32_t lowPulse, uint32_t highPulse);
+
+// Readings of the UART autobaud unit
+typedef struct
+{
+    bool enabled;
+    uint32_t edges;      // UART_RXD_CNT_REG
+    uint32_t lowPulse;   // UART_LOWPULSE_REG
+    uint32_t highPulse;  // UART_HIGHPULSE_REG
+} autobaudUnit_t;
+
+typedef enum : uint8_t
+{
+    AUTOBAUD_KEEP,  // leave the autobaud unit as it is
+    AUTOBAUD_START, // enable the autobaud unit
+    AUTOBAUD_STOP   // the pulse widths were used, disable the autobaud unit
+} autobaudAction_e;
+
+/**
+ * @brief The UART watchdog and the baud rate search for the handset, without the UART itself
+ *
+ * check() tells when the packet counts are due, next() steps the search whenever the handset is
+ * not connected. The search measures the baud rate with the autobaud unit, and on a half duplex
+ * UART tries the measured rate with the inversion flipped as well.
+ */
+class HandsetBaud
+{
+public:
+    /**
+     * @brief Start the watchdog, e.g. after the UART was opened
+     * @param cachedBaud the UART starts with the baud rate the handset was last connected with, which
+     * is given a whole connected interval before the search starts
+     */
+    void begin(uint32_t nowMS, bool cachedBaud)
+    {
+        lastCheckedMS = nowMS;
+        grace = cachedBaud;
+    }
+
+    /**
+     * @return interval of the watchdog checks
+     * @param rcIntervalUS RC packet interval, only used while connected
+     */
+    static uint32_t interval(bool connected, uint32_t rcIntervalUS);
+
+    /**
+     * @return true once per interval(), when the packet counts are to be checked
+     */
+    bool check(uint32_t nowMS, bool connected, uint32_t rcIntervalUS);
+
+    /**
+     * @brief One step of the search, called by every check() without a connection
+     * @param unit readings of the autobaud unit
+     * @param halfDuplex only a half duplex UART can be inverted
+     * @param inverted the inversion of the UART, flipped by the search
+     * @param currentBaud the baud rate of the UART
+     * @param action receives what to do with the autobaud unit
+     * @return the baud rate to try next
+     */
+    uint32_t next(const autobaudUnit_t &unit, bool halfDuplex, bool &inverted, uint32_t currentBaud, autobaudAction_e &action);
+
+private:
+    enum : uint8_t { INIT, MEASURED, INVERTED } state = INIT;
+    uint32_t lastCheckedMS = 0;
+    bool grace = false; // the first check waits as long as if the handset were connected
+};
@@ -25,10 +25,10 @@ void (*hwTimer::callbackFunc)() = nullptr;
 
 volatile bool hwTimer::running = false;
 volatile uint32_t hwTimer::HWtimerIntervalUS = TimerIntervalUSDefault;
+volatile bool hwTimer::intervalChanged = false;
 
 // Internal implementation specific variables
 static hw_timer_t *timer = NULL;
-static portMUX_TYPE isrMutex = portMUX_INITIALIZER_UNLOCKED;
 
 #define HWTIMER_FREQUENCY 1000000 // 1 MHz
 
@@ -65,11 +65,18 @@ void ICACHE_RAM_ATTR hwTimer::resume()
 
 void ICACHE_RAM_ATTR hwTimer::updateIntervalUS(uint32_t timeUS)
 {
-    // timer should not be running when updateIntervalUS() is called
     HWtimerIntervalUS = timeUS;
     if (timer)
     {
-        timerAlarm(timer, HWtimerIntervalUS, true, 0);
+        if (running)
+        {
+            // Applied in callback(), right after the counter has been reloaded
+            intervalChanged = true;
+        }
+        else
+        {
+            timerAlarm(timer, HWtimerIntervalUS, true, 0);
+        }
     }
 }
 
@@ -77,8 +84,11 @@ void ICACHE_RAM_ATTR hwTimer::callback(void)
 {
     if (running)
     {
-        portENTER_CRITICAL_ISR(&isrMutex);
+        if (intervalChanged)
+        {
+            intervalChanged = false;
+            timerAlarm(timer, HWtimerIntervalUS, true, 0);
+        }
         callbackFunc();
-        portEXIT_CRITICAL_ISR(&isrMutex);
     }
 }
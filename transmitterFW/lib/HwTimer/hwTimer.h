@@ -29,7 +29,7 @@
 /**
  * @brief Hardware abstraction for the hardware timer to provide precise timing.
  *
- * The timer provides a callback.
+ * The timer provides a callback, which is called from the timer interrupt and must be kept short.
  */
 class hwTimer
 {
@@ -58,7 +58,8 @@ public:
 
     /**
      * @brief Change the interval between callbacks.
-     * The timer should not be running when updateIntervalUS() is called.
+     * If the timer is running, the new interval takes effect right after the next callback,
+     * so that the period in progress is neither cut short nor stretched.
      *
      * @param time in microseconds.
      */
@@ -72,4 +73,5 @@ private:
     static void (*callbackFunc)();
 
     static volatile uint32_t HWtimerIntervalUS;
+    static volatile bool intervalChanged;
 };
@@ -0,0 +1,99 @@
+/*
+ * This file belongs to the CyberBrick ESP-NOW transmitter & receiver project, hosted originally at:
+ * https://github.com/rotorman/CyberBrick_ESPNOW
+ * Copyright (C) 2025, Risto Kõiva
+ *
+ * Large parts of the code are based on the wonderful ExpressLRS project:
+ * https://github.com/ExpressLRS/ExpressLRS
+ *
+ * License GPL-3.0: https://www.gnu.org/licenses/gpl-3.0.html
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * @brief Link quality over a sliding window of the last N packets, in percent
+ *
+ * Not thread safe, callers in different tasks have to hold a common lock.
+ *
+ * @tparam N number of packets in the window
+ */
+template <uint8_t N>
+class LQCALC
+{
+public:
+    LQCALC() { reset(); }
+
+    /**
+     * @brief Add the result of a packet, dropping the oldest one from the window once it is full
+     */
+    void add(bool success)
+    {
+        const uint32_t mask = 1UL << (index % 32);
+        uint32_t &word = results[index / 32];
+        if (count == N)
+        {
+            // Drop the oldest result, stored at the position of the new one
+            if (word & mask) successCount--;
+        }
+        else
+        {
+            count++;
+        }
+
+        if (success)
+        {
+            word |= mask;
+            successCount++;
+        }
+        else
+        {
+            word &= ~mask;
+        }
+        index = (index + 1) % N;
+    }
+
+    /**
+     * @return the percentage of successful packets in the window, 0 if there are none yet
+     */
+    uint8_t getLQ() const
+    {
+        if (count == 0)
+            return 0;
+        return (uint32_t)successCount * 100 / count;
+    }
+
+    /**
+     * @return the number of packets in the window, up to N
+     */
+    uint8_t getCount() const { return count; }
+
+    void reset()
+    {
+        for (uint8_t i=0; i<sizeof(results)/sizeof(results[0]); i++)
+        {
+            results[i] = 0;
+        }
+        index = 0;
+        count = 0;
+        successCount = 0;
+    }
+
+private:
+    uint32_t results[(N + 31) / 32]; // one bit per packet, 1 for success
+    uint8_t index;                   // position of the next result
+    uint8_t count;
+    uint8_t successCount;
+};
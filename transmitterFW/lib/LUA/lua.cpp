@@ -0,0 +1,168 @@
+/*
+ * This file belongs to the CyberBrick ESP-NOW transmitter & receiver project, hosted originally at:
+ * https://github.com/rotorman/CyberBrick_ESPNOW
+ * Copyright (C) 2025, Risto Kõiva
+ *
+ * Large parts of the code are based on the wonderful ExpressLRS project:
+ * https://github.com/ExpressLRS/ExpressLRS
+ *
+ * License GPL-3.0: https://www.gnu.org/licenses/gpl-3.0.html
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "lua.h"
+#include "CRSFHandset.h"
+
+extern CRSFHandset *handset;
+
+static constexpr uint8_t LUA_MAX_PARAMS = 16;
+
+static struct luaPropertiesCommon *paramDefinitions[LUA_MAX_PARAMS + 1] = {0}; // index 0 is the root folder
+static luaCallback paramCallbacks[LUA_MAX_PARAMS + 1] = {0};
+static uint8_t lastLuaField = 0;
+
+static uint8_t *luaTextSelectionStructToArray(const void *luaStruct, uint8_t *next)
+{
+    const struct luaItem_selection *p1 = (const struct luaItem_selection *)luaStruct;
+    uint8_t count = 0;
+    for (const char *c = p1->options; *c; c++)
+    {
+        if (*c == ';') count++;
+    }
+    next = (uint8_t *)stpcpy((char *)next, p1->options) + 1;
+    *next++ = p1->value; // value
+    *next++ = 0;         // min
+    *next++ = count;     // max
+    *next++ = 0;         // default
+    return (uint8_t *)stpcpy((char *)next, p1->units) + 1;
+}
+
+static uint8_t *luaStringStructToArray(const void *luaStruct, uint8_t *next)
+{
+    const struct luaItem_string *p1 = (const struct luaItem_string *)luaStruct;
+    return (uint8_t *)stpcpy((char *)next, p1->value) + 1;
+}
+
+static uint8_t *luaFolderStructToArray(uint8_t parent, uint8_t *next)
+{
+    // List of the ids of all children, terminated by 0xFF
+    for (uint8_t i=1; i<=lastLuaField; i++)
+    {
+        if (paramDefinitions[i]->parent == parent)
+        {
+            *next++ = i;
+        }
+    }
+    *next++ = 0xFF;
+    return next;
+}
+
+/**
+ * Send the requested chunk of a parameter entry to the handset.
+ * Chunk 0: [FieldId][ChunksRemain][Parent][Type][Name\0][type specific data]
+ * Chunk 1-N: [FieldId][ChunksRemain][continued data]
+ **/
+static void sendCRSFparam(uint8_t fieldId, uint8_t fieldChunk)
+{
+    uint8_t chunkBuffer[CRSF_MAX_PACKET_LEN * 4];
+    uint8_t *dataEnd;
+
+    // Start the field payload at 2 to leave room for (FieldId + ChunksRemain)
+    if (fieldId == 0)
+    {
+        chunkBuffer[2] = 0;
+        chunkBuffer[3] = CRSF_FOLDER;
+        dataEnd = (uint8_t *)stpcpy((char *)&chunkBuffer[4], device_name) + 1;
+        dataEnd = luaFolderStructToArray(0, dataEnd);
+    }
+    else
+    {
+        struct luaPropertiesCommon *luaData = paramDefinitions[fieldId];
+        const uint8_t dataType = luaData->type & CRSF_FIELD_TYPE_MASK;
+        chunkBuffer[2] = luaData->parent;
+        chunkBuffer[3] = luaData->type;
+        dataEnd = (uint8_t *)stpcpy((char *)&chunkBuffer[4], luaData->name) + 1;
+        switch (dataType)
+        {
+        case CRSF_TEXT_SELECTION:
+            dataEnd = luaTextSelectionStructToArray(luaData, dataEnd);
+            break;
+        case CRSF_INFO:
+            dataEnd = luaStringStructToArray(luaData, dataEnd);
+            break;
+        case CRSF_FOLDER:
+            dataEnd = luaFolderStructToArray(fieldId, dataEnd);
+            break;
+        default:
+            return;
+        }
+    }
+
+    // Maximum number of chunked bytes that can be sent in one response
+    // 6 bytes CRSF header/CRC: Dest, Len, Type, ExtSrc, ExtDst, CRC
+    // 2 bytes Lua chunk header: FieldId, ChunksRemain
+    const int chunkMax = handset->GetMaxPacketBytes() - 6 - 2;
+    if (chunkMax <= 0)
+        return;
+    const uint8_t dataLen = dataEnd - &chunkBuffer[2];
+    const uint8_t chunkCnt = (dataLen + chunkMax - 1) / chunkMax;
+    if (fieldChunk >= chunkCnt)
+        return;
+
+    uint8_t *chunkStart = &chunkBuffer[2] + fieldChunk * chunkMax;
+    const uint8_t chunkSize = std::min((int)(dataEnd - chunkStart), chunkMax);
+
+    // Move chunkStart back 2 bytes to add (FieldId + ChunksRemain) to each packet
+    chunkStart -= 2;
+    chunkStart[0] = fieldId;
+    chunkStart[1] = chunkCnt - (fieldChunk + 1);
+    CRSFHandset::packetQueueExtended(CRSF_FRAMETYPE_PARAMETER_SETTINGS_ENTRY, chunkStart, chunkSize + 2);
+}
+
+void registerLUAParameter(void *definition, luaCallback callback, uint8_t parent)
+{
+    if (lastLuaField >= LUA_MAX_PARAMS)
+        return;
+
+    struct luaPropertiesCommon *p = (struct luaPropertiesCommon *)definition;
+    lastLuaField++;
+    p->id = lastLuaField;
+    p->parent = parent;
+    paramDefinitions[p->id] = p;
+    paramCallbacks[p->id] = callback;
+}
+
+uint8_t getLUAParameterCount()
+{
+    return lastLuaField;
+}
+
+void luaHandleUpdateParameter(uint8_t type, uint8_t fieldId, uint8_t arg)
+{
+    if (fieldId > lastLuaField)
+        return;
+
+    if (type == CRSF_FRAMETYPE_PARAMETER_WRITE && fieldId > 0)
+    {
+        struct luaPropertiesCommon *p = paramDefinitions[fieldId];
+        if ((p->type & CRSF_FIELD_TYPE_MASK) == CRSF_TEXT_SELECTION)
+        {
+            ((struct luaItem_selection *)p)->value = arg;
+        }
+        // The handset reads the parameter back after writing it
+        if (paramCallbacks[fieldId]) paramCallbacks[fieldId](p, arg);
+    }
+    else if (type == CRSF_FRAMETYPE_PARAMETER_READ)
+    {
+        sendCRSFparam(fieldId, arg);
+    }
+}
@@ -0,0 +1,74 @@
+/*
+ * This file belongs to the CyberBrick ESP-NOW transmitter & receiver project, hosted originally at:
+ * https://github.com/rotorman/CyberBrick_ESPNOW
+ * Copyright (C) 2025, Risto Kõiva
+ *
+ * Large parts of the code are based on the wonderful ExpressLRS project:
+ * https://github.com/ExpressLRS/ExpressLRS
+ *
+ * License GPL-3.0: https://www.gnu.org/licenses/gpl-3.0.html
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include "crsf_protocol.h"
+
+/*
+ * CRSF parameter protocol, as used by the EdgeTX ExpressLRS/CRSF device Lua scripts under
+ * SYS -> Tools. The handset reads the parameters one by one after a device ping and writes
+ * a parameter when it is changed by the user.
+ */
+
+struct luaPropertiesCommon
+{
+    const char *const name; // display name
+    const uint8_t type;     // crsf_value_type_e, optionally or'ed with CRSF_FIELD_HIDDEN
+    uint8_t id;             // assigned by registerLUAParameter()
+    uint8_t parent;         // id of the parent folder, 0 for the root
+};
+
+struct luaItem_selection
+{
+    struct luaPropertiesCommon common;
+    uint8_t value;
+    const char *const options; // selection options, separated by ';'
+    const char *const units;
+};
+
+struct luaItem_string
+{
+    struct luaPropertiesCommon common;
+    const char *value; // read-only text, shown with CRSF_INFO
+};
+
+typedef void (*luaCallback)(struct luaPropertiesCommon *item, uint8_t arg);
+
+/**
+ * @brief Add a parameter to the list read by the handset, in the order of registration
+ * @param definition pointer to a luaItem_* struct
+ * @param callback called with the new value when the handset writes the parameter
+ */
+void registerLUAParameter(void *definition, luaCallback callback = nullptr, uint8_t parent = 0);
+
+/**
+ * @return the number of registered parameters, reported in the device information
+ */
+uint8_t getLUAParameterCount();
+
+/**
+ * @brief Handle a parameter read or write request from the handset
+ * @param type CRSF_FRAMETYPE_PARAMETER_READ or CRSF_FRAMETYPE_PARAMETER_WRITE
+ * @param fieldId the parameter id
+ * @param arg chunk number for reads, the new value for writes
+ */
+void luaHandleUpdateParameter(uint8_t type, uint8_t fieldId, uint8_t arg);
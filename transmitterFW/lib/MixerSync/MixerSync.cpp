@@ -0,0 +1,139 @@
+/*
+ * This file belongs to the CyberBrick ESP-NOW transmitter & receiver project, hosted originally at:
+ * https://github.com/rotorman/CyberBrick_ESPNOW
+ * Copyright (C) 2025, Risto Kõiva
+ *
+ * License GPL-3.0: https://www.gnu.org/licenses/gpl-3.0.html
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "MixerSync.h"
+
+void MixerSync::acquire(uint32_t nowMS)
+{
+    averaged = 0;
+    outlierRun = 0;
+    settleSamples = 0;
+    lockRun = 0;
+    acquiring = true;
+    acquiredMS = nowMS;
+    stats.acquisitions++;
+    stats.convergenceMS = 0;
+    hasEstimate.store(false, std::memory_order_relaxed);
+}
+
+void MixerSync::updateStats()
+{
+    stats.phaseUS = (phaseQ + 128) >> 8;
+    stats.jitterUS = (uint32_t)(jitterQ + 128) >> 8;
+    stats.driftPPM = (int32_t)((int64_t)driftQ * 1000000 / 256 / (int32_t)intervalUS);
+}
+
+int32_t MixerSync::getOffsetUS(uint32_t nextUS) const
+{
+    const uint32_t interval = publishedIntervalUS.load(std::memory_order_relaxed);
+    if (!hasEstimate.load(std::memory_order_acquire) || interval == 0)
+        return 0;
+    const int64_t driftQ = publishedDriftQ.load(std::memory_order_relaxed);
+    const int32_t offsetUS = publishedPhaseUS.load(std::memory_order_relaxed) - MIXER_SYNC_TARGET_US +
+                             (int32_t)(driftQ * (nextUS / 2) / interval / 256);
+    return (offsetUS > MIXER_SYNC_DEADBAND_US || offsetUS < -MIXER_SYNC_DEADBAND_US) ? offsetUS : 0;
+}
+
+void ICACHE_RAM_ATTR MixerSync::addSample(int32_t deltaUS, uint32_t nowMS)
+{
+    const uint32_t newIntervalUS = pendingIntervalUS.exchange(0, std::memory_order_acquire);
+    if (newIntervalUS != 0)
+    {
+        intervalUS = newIntervalUS;
+        driftQ = 0;
+        driftRemainder = 0;
+        acquire(nowMS);
+        publishedDriftQ.store(0, std::memory_order_relaxed);
+        publishedIntervalUS.store(intervalUS, std::memory_order_relaxed);
+    }
+    if (intervalUS == 0)
+        return;
+
+    if (settleRequested.exchange(false, std::memory_order_acquire))
+    {
+        // Nothing is to be corrected twice
+        settleSamples = MIXER_SYNC_SETTLE;
+        hasEstimate.store(false, std::memory_order_relaxed);
+    }
+    if (settleSamples > 0)
+    {
+        // The mixer moves somewhere in these samples, average the new phase from scratch
+        if (--settleSamples == 0)
+            averaged = 0;
+        return;
+    }
+
+    const int32_t interval = (int32_t)intervalUS;
+    int32_t phase = (deltaUS - MIXER_SYNC_TARGET_US + interval / 2) % interval;
+    if (phase < 0)
+        phase += interval;
+    const int32_t sampleQ = (phase + MIXER_SYNC_TARGET_US - interval / 2) * 256;
+
+    if (averaged == 0)
+    {
+        phaseQ = sampleQ;
+        averaged = 1;
+        stats.samples++;
+        return;
+    }
+
+    const int32_t predictedQ = phaseQ + driftQ;
+    const int32_t errorQ = sampleQ - predictedQ;
+    const int32_t absErrorQ = errorQ < 0 ? -errorQ : errorQ;
+    int32_t gateQ = jitterQ * MIXER_SYNC_GATE_JITTERS;
+    if (gateQ < MIXER_SYNC_GATE_MIN_US * 256)
+        gateQ = MIXER_SYNC_GATE_MIN_US * 256;
+
+    if (absErrorQ > gateQ)
+    {
+        stats.outliers++;
+        phaseQ = predictedQ;
+        if (++outlierRun >= MIXER_SYNC_REACQUIRE)
+            acquire(nowMS);
+        return;
+    }
+
+    outlierRun = 0;
+    stats.samples++;
+    if (averaged < MIXER_SYNC_AVERAGE)
+        averaged++;
+    phaseQ = predictedQ + errorQ / averaged;
+    jitterQ += (absErrorQ - jitterQ) / MIXER_SYNC_JITTER_GAIN;
+    if (averaged < MIXER_SYNC_PUBLISH)
+        return;
+
+    // The remainder is carried, errors below MIXER_SYNC_DRIFT_GAIN / 256 us would never move the drift otherwise
+    driftRemainder += errorQ;
+    driftQ += driftRemainder / MIXER_SYNC_DRIFT_GAIN;
+    driftRemainder %= MIXER_SYNC_DRIFT_GAIN;
+    publishedDriftQ.store(driftQ, std::memory_order_relaxed);
+    publishedPhaseUS.store((phaseQ + 128) >> 8, std::memory_order_relaxed);
+    hasEstimate.store(true, std::memory_order_release);
+    updateStats();
+    if (acquiring)
+    {
+        acquiring = false;
+        resync.store(true, std::memory_order_release);
+    }
+
+    const int32_t lockErrorQ = phaseQ - MIXER_SYNC_TARGET_US * 256;
+    if (lockErrorQ > MIXER_SYNC_LOCK_US * 256 || lockErrorQ < -MIXER_SYNC_LOCK_US * 256)
+        lockRun = 0;
+    else if (lockRun < MIXER_SYNC_LOCK_SAMPLES && ++lockRun == MIXER_SYNC_LOCK_SAMPLES && stats.convergenceMS == 0)
+        stats.convergenceMS = nowMS - acquiredMS;
+}
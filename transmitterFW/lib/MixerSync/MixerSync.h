@@ -0,0 +1,136 @@
+/*
+ * This file belongs to the CyberBrick ESP-NOW transmitter & receiver project, hosted originally at:
+ * https://github.com/rotorman/CyberBrick_ESPNOW
+ * Copyright (C) 2025, Risto Kõiva
+ *
+ * License GPL-3.0: https://www.gnu.org/licenses/gpl-3.0.html
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+#ifndef ICACHE_RAM_ATTR
+#define ICACHE_RAM_ATTR
+#endif
+
+#define MIXER_SYNC_TARGET_US 100       // headroom between the handset packet and the RF send the mixer is moved to
+#define MIXER_SYNC_AVERAGE 8           // samples averaged after a start, afterwards the estimate moves by 1/8 of the error
+#define MIXER_SYNC_PUBLISH 4           // samples averaged before the estimate is sent to the handset
+#define MIXER_SYNC_DRIFT_GAIN 512      // the drift estimate moves by 1/512 of the error
+#define MIXER_SYNC_JITTER_GAIN 16      // the jitter estimate moves by 1/16 of the change
+#define MIXER_SYNC_GATE_JITTERS 4      // samples further off than this many times the jitter
+#define MIXER_SYNC_GATE_MIN_US 40      // and this are outliers
+#define MIXER_SYNC_REACQUIRE 8         // consecutive outliers after which the phase is measured from scratch
+#define MIXER_SYNC_SETTLE 3            // samples ignored after a correction was sent, while the mixer moves
+#define MIXER_SYNC_DEADBAND_US 8       // smaller corrections are lost in the jitter and not sent
+#define MIXER_SYNC_LOCK_US 30          // the mixer is aligned once the phase stays this close to the target
+#define MIXER_SYNC_LOCK_SAMPLES 16     // for this many samples
+
+// Mixer sync statistics
+typedef struct
+{
+    int32_t phaseUS;        // estimated time from the handset packet to the RF send
+    uint32_t jitterUS;      // mean deviation of the accepted samples from the estimate
+    int32_t driftPPM;       // phase change between the handset mixer and the RF send timer
+    uint32_t samples;       // samples accepted
+    uint32_t outliers;      // samples rejected, e.g. late or missing handset packets
+    uint32_t acquisitions;  // times the phase was measured from scratch
+    uint32_t convergenceMS; // last acquisition to the mixer being aligned, 0 until it is
+} mixerSyncStats_t;
+
+/**
+ * @brief Estimates the phase between the handset mixer and the RF send timer for the EdgeTX mixer sync
+ *
+ * Every RF send adds the time since the last handset packet as sample. The sample is folded into one
+ * packet interval around MIXER_SYNC_TARGET_US, so that a handset packet arriving just after the send
+ * counts as slightly negative phase instead of almost a whole interval of waiting.
+ *
+ * The phase and its drift are tracked with an alpha-beta filter, the drift makes up for the clocks of
+ * the handset and the RF send timer running apart between two corrections. Samples too far off the prediction,
+ * as from delayed or missing handset packets, are rejected instead of pulling the estimate. Only a
+ * run of them means the mixer moved, then the phase is measured from scratch and takeResync() asks
+ * for a sync packet right away. After a sync packet with a correction, a few samples are skipped
+ * while the mixer moves, and the phase is averaged again. Corrections within the jitter are not
+ * sent, so that the estimate keeps averaging once the mixer is aligned.
+ *
+ * addSample() is only called from the task sending the frames, the other functions are safe to be
+ * called from another task.
+ */
+class MixerSync
+{
+public:
+    /**
+     * @brief Start over with a new packet interval
+     */
+    void setInterval(uint32_t intervalUS)
+    {
+        pendingIntervalUS.store(intervalUS, std::memory_order_release);
+    }
+
+    /**
+     * @brief Add the time between the last handset packet and an RF send
+     * @param deltaUS micros() of the send minus micros() of the handset packet
+     */
+    void addSample(int32_t deltaUS, uint32_t nowMS);
+
+    /**
+     * @brief A sync packet asking the mixer to move by offsetUS was sent
+     */
+    void correctionSent(int32_t offsetUS)
+    {
+        if (offsetUS != 0)
+            settleRequested.store(true, std::memory_order_release);
+    }
+
+    /**
+     * @brief How far the mixer is to be moved, so that it is centered on the target until the next correction
+     * @param nextUS time until the next correction, the drift until half of it is included
+     * @return 0 while there is no estimate, e.g. while the mixer moves, or if the mixer is within
+     * MIXER_SYNC_DEADBAND_US of the target
+     */
+    int32_t getOffsetUS(uint32_t nextUS) const;
+
+    /**
+     * @return true once after a new estimate is available, which is to be sent right away
+     */
+    bool takeResync() { return resync.exchange(false, std::memory_order_acq_rel); }
+
+    const mixerSyncStats_t &getStats() const { return stats; }
+
+private:
+    void acquire(uint32_t nowMS);
+    void updateStats();
+
+    uint32_t intervalUS = 0;
+    int32_t phaseQ = 0;      // in 1/256 us
+    int32_t driftQ = 0;      // phase change per sample, in 1/256 us
+    int32_t driftRemainder = 0; // error not added to driftQ yet, in 1/256 us
+    int32_t jitterQ = 0;     // in 1/256 us
+    uint8_t averaged = 0;    // samples in the estimate, up to MIXER_SYNC_AVERAGE
+    uint8_t outlierRun = 0;
+    uint8_t settleSamples = 0;
+    uint8_t lockRun = 0;
+    bool acquiring = false;  // no estimate was published since the last acquisition
+    uint32_t acquiredMS = 0;
+    mixerSyncStats_t stats = {};
+
+    std::atomic<uint32_t> pendingIntervalUS {0};
+    std::atomic<bool> settleRequested {false};
+    std::atomic<bool> resync {false};
+    std::atomic<bool> hasEstimate {false}; // not while the mixer moves
+    std::atomic<int32_t> publishedPhaseUS {0};
+    std::atomic<int32_t> publishedDriftQ {0};
+    std::atomic<uint32_t> publishedIntervalUS {0};
+};
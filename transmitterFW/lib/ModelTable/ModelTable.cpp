@@ -0,0 +1,162 @@
+/*
+ * This file belongs to the CyberBrick ESP-NOW transmitter & receiver project, hosted originally at:
+ * https://github.com/rotorman/CyberBrick_ESPNOW
+ * Copyright (C) 2025, Risto Kõiva
+ *
+ * License GPL-3.0: https://www.gnu.org/licenses/gpl-3.0.html
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "ModelTable.h"
+#include <string.h>
+
+static const char MODEL_TABLE_KEY[] = "models"; // learned addresses, all zero for models not bound
+
+bool ModelTable::isValid(const uint8_t *mac)
+{
+    for (uint8_t i = 0; i < MODEL_MAC_LEN; i++)
+    {
+        if (mac[i] != 0)
+            return true;
+    }
+    return false;
+}
+
+void ModelTable::begin(Preferences &prefs, const uint8_t (*defaults)[MODEL_MAC_LEN], uint8_t defaultCount)
+{
+    preferences = &prefs;
+    if (defaultCount > MODEL_TABLE_SIZE)
+        defaultCount = MODEL_TABLE_SIZE;
+    memcpy(macs, defaults, defaultCount * MODEL_MAC_LEN);
+
+    uint8_t learned[MODEL_TABLE_SIZE][MODEL_MAC_LEN];
+    if (prefs.getBytesLength(MODEL_TABLE_KEY) == sizeof(learned) &&
+        prefs.getBytes(MODEL_TABLE_KEY, learned, sizeof(learned)) == sizeof(learned))
+    {
+        for (uint8_t model = 0; model < MODEL_TABLE_SIZE; model++)
+        {
+            if (isValid(learned[model]))
+                memcpy(macs[model], learned[model], MODEL_MAC_LEN);
+        }
+    }
+
+    memset(peerSlotOfModel, MODEL_NO_PEER_SLOT, sizeof(peerSlotOfModel));
+    memset(modelOfPeerSlot, MODEL_TABLE_SIZE, sizeof(modelOfPeerSlot));
+}
+
+bool ModelTable::getMAC(uint8_t modelId, uint8_t *mac) const
+{
+    if (modelId >= MODEL_TABLE_SIZE)
+        return false;
+
+    portENTER_CRITICAL(&macLock);
+    memcpy(mac, macs[modelId], MODEL_MAC_LEN);
+    portEXIT_CRITICAL(&macLock);
+    return isValid(mac);
+}
+
+void ModelTable::setMAC(uint8_t modelId, const uint8_t *mac)
+{
+    if (modelId >= MODEL_TABLE_SIZE)
+        return;
+
+    portENTER_CRITICAL(&macLock);
+    memcpy(macs[modelId], mac, MODEL_MAC_LEN);
+    macChanged[modelId] = true;
+    portEXIT_CRITICAL(&macLock);
+
+    uint8_t learned[MODEL_TABLE_SIZE][MODEL_MAC_LEN];
+    if (preferences->getBytesLength(MODEL_TABLE_KEY) != sizeof(learned) ||
+        preferences->getBytes(MODEL_TABLE_KEY, learned, sizeof(learned)) != sizeof(learned))
+    {
+        memset(learned, 0, sizeof(learned));
+    }
+    memcpy(learned[modelId], mac, MODEL_MAC_LEN);
+    preferences->putBytes(MODEL_TABLE_KEY, learned, sizeof(learned));
+}
+
+void ModelTable::releasePeerSlot(uint8_t slot)
+{
+    // Several models may share a receiver, keep the peer as long as one of them uses it
+    bool shared = false;
+    for (uint8_t s = 0; s < MODEL_PEER_SLOTS; s++)
+    {
+        if (s != slot && modelOfPeerSlot[s] != MODEL_TABLE_SIZE && memcmp(peerSlotMAC[s], peerSlotMAC[slot], MODEL_MAC_LEN) == 0)
+            shared = true;
+    }
+    if (!shared)
+        esp_now_del_peer(peerSlotMAC[slot]);
+    peerSlotOfModel[modelOfPeerSlot[slot]] = MODEL_NO_PEER_SLOT;
+    modelOfPeerSlot[slot] = MODEL_TABLE_SIZE;
+}
+
+const uint8_t *ModelTable::acquirePeer(uint8_t modelId, bool &added)
+{
+    added = false;
+    if (modelId >= MODEL_TABLE_SIZE)
+        return nullptr;
+
+    uint8_t mac[MODEL_MAC_LEN];
+    portENTER_CRITICAL(&macLock);
+    memcpy(mac, macs[modelId], MODEL_MAC_LEN);
+    const bool changed = macChanged[modelId];
+    macChanged[modelId] = false;
+    portEXIT_CRITICAL(&macLock);
+    if (!isValid(mac))
+        return nullptr;
+
+    uint8_t slot = peerSlotOfModel[modelId];
+    if (changed && slot != MODEL_NO_PEER_SLOT)
+    {
+        // Re-register the model below with its new address
+        releasePeerSlot(slot);
+        slot = MODEL_NO_PEER_SLOT;
+    }
+
+    if (slot != MODEL_NO_PEER_SLOT)
+    {
+        peerSlotLastUse[slot] = ++useCounter;
+        return peerSlotMAC[slot];
+    }
+
+    // Take a free slot, otherwise the least recently used one
+    slot = 0;
+    for (uint8_t s = 0; s < MODEL_PEER_SLOTS; s++)
+    {
+        if (modelOfPeerSlot[s] == MODEL_TABLE_SIZE)
+        {
+            slot = s;
+            break;
+        }
+        if (peerSlotLastUse[s] < peerSlotLastUse[slot])
+            slot = s;
+    }
+    if (modelOfPeerSlot[slot] != MODEL_TABLE_SIZE)
+        releasePeerSlot(slot);
+
+    esp_now_peer_info_t peerInfo;
+    memset(&peerInfo, 0, sizeof(peerInfo));
+    peerInfo.channel = 0; // the current WiFi channel
+    peerInfo.ifidx = WIFI_IF_STA;
+    peerInfo.encrypt = false;
+    memcpy(peerInfo.peer_addr, mac, MODEL_MAC_LEN);
+    const esp_err_t result = esp_now_add_peer(&peerInfo);
+    if (result != ESP_OK && result != ESP_ERR_ESPNOW_EXIST)
+        return nullptr;
+
+    memcpy(peerSlotMAC[slot], mac, MODEL_MAC_LEN);
+    modelOfPeerSlot[slot] = modelId;
+    peerSlotOfModel[modelId] = slot;
+    peerSlotLastUse[slot] = ++useCounter;
+    added = true;
+    return peerSlotMAC[slot];
+}
@@ -0,0 +1,89 @@
+/*
+ * This file belongs to the CyberBrick ESP-NOW transmitter & receiver project, hosted originally at:
+ * https://github.com/rotorman/CyberBrick_ESPNOW
+ * Copyright (C) 2025, Risto Kõiva
+ *
+ * License GPL-3.0: https://www.gnu.org/licenses/gpl-3.0.html
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <esp_now.h>
+#include <Preferences.h>
+
+#define MODEL_TABLE_SIZE 64      // EdgeTX receiver numbers 0-63
+#define MODEL_MAC_LEN 6
+#define MODEL_NO_PEER_SLOT 0xFF
+#ifndef MODEL_PEER_SLOTS
+#define MODEL_PEER_SLOTS ESP_NOW_MAX_TOTAL_PEER_NUM
+#endif
+
+/**
+ * @brief Receiver MAC address of every model, indexed by the EdgeTX receiver number
+ *
+ * The table starts with the MAC addresses compiled into the firmware. Addresses learned by binding
+ * are stored in NVS and take precedence over them.
+ *
+ * ESP-NOW only holds a limited number of peers, so the receivers are registered on first use and
+ * the least recently used one is removed when all peer slots are taken. Switching to a model which
+ * was used recently costs nothing, any other model one esp_now_del_peer() and esp_now_add_peer().
+ *
+ * acquirePeer() is only called from the task sending the frames, the other functions may be called
+ * from any task. The addresses are only read and written under a spinlock, as binding sets them in
+ * the loop while the send task and the ESP-NOW send callback read them.
+ */
+class ModelTable
+{
+public:
+    /**
+     * @brief Load the table
+     * @param prefs opened NVS namespace, kept for storing learned addresses
+     * @param defaults MAC addresses of models 0 to defaultCount-1 compiled into the firmware
+     */
+    void begin(Preferences &prefs, const uint8_t (*defaults)[MODEL_MAC_LEN], uint8_t defaultCount);
+
+    /**
+     * @brief Copy the MAC address of the receiver of the model
+     * @return false if the model has none
+     */
+    bool getMAC(uint8_t modelId, uint8_t *mac) const;
+
+    /**
+     * @brief Assign a receiver to a model and store it in NVS
+     */
+    void setMAC(uint8_t modelId, const uint8_t *mac);
+
+    /**
+     * @brief Make sure the receiver of the model is registered as ESP-NOW peer
+     * @param added set to true if the peer was (re)registered, so that its settings are to be applied again
+     * @return the address the peer is registered with, valid until the next acquirePeer(), nullptr if
+     * the model has no receiver or the peer could not be added
+     */
+    const uint8_t *acquirePeer(uint8_t modelId, bool &added);
+
+private:
+    static bool isValid(const uint8_t *mac);
+    void releasePeerSlot(uint8_t slot);
+
+    mutable portMUX_TYPE macLock = portMUX_INITIALIZER_UNLOCKED; // guards macs and macChanged
+
+    Preferences *preferences = nullptr;
+    uint8_t macs[MODEL_TABLE_SIZE][MODEL_MAC_LEN] = {};
+    bool macChanged[MODEL_TABLE_SIZE] = {};           // the registered peer has an outdated address
+    uint8_t peerSlotOfModel[MODEL_TABLE_SIZE];        // MODEL_NO_PEER_SLOT if not registered
+    uint8_t modelOfPeerSlot[MODEL_PEER_SLOTS];        // MODEL_TABLE_SIZE if the slot is free
+    uint8_t peerSlotMAC[MODEL_PEER_SLOTS][MODEL_MAC_LEN];
+    uint32_t peerSlotLastUse[MODEL_PEER_SLOTS] = {};
+    uint32_t useCounter = 0;
+};
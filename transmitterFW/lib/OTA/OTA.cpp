@@ -0,0 +1,476 @@
+/*
+ * This file belongs to the CyberBrick ESP-NOW transmitter & receiver project, hosted originally at:
+ * https://github.com/rotorman/CyberBrick_ESPNOW
+ * Copyright (C) 2025, Risto Kõiva
+ *
+ * License GPL-3.0: https://www.gnu.org/licenses/gpl-3.0.html
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "OTA.h"
+#include <string.h>
+
+/**
+ * Pack 8 channels into OTA_GROUP_BYTES bytes, the unrolled form of the bit accumulator loop below
+ **/
+static inline void packGroup(uint8_t *dst, const uint16_t *channels)
+{
+    const uint16_t c0 = channels[0] & OTA_CHANNEL_MASK;
+    const uint16_t c1 = channels[1] & OTA_CHANNEL_MASK;
+    const uint16_t c2 = channels[2] & OTA_CHANNEL_MASK;
+    const uint16_t c3 = channels[3] & OTA_CHANNEL_MASK;
+    const uint16_t c4 = channels[4] & OTA_CHANNEL_MASK;
+    const uint16_t c5 = channels[5] & OTA_CHANNEL_MASK;
+    const uint16_t c6 = channels[6] & OTA_CHANNEL_MASK;
+    const uint16_t c7 = channels[7] & OTA_CHANNEL_MASK;
+    dst[0] = (uint8_t)c0;
+    dst[1] = (uint8_t)(c0 >> 8 | c1 << 3);
+    dst[2] = (uint8_t)(c1 >> 5 | c2 << 6);
+    dst[3] = (uint8_t)(c2 >> 2);
+    dst[4] = (uint8_t)(c2 >> 10 | c3 << 1);
+    dst[5] = (uint8_t)(c3 >> 7 | c4 << 4);
+    dst[6] = (uint8_t)(c4 >> 4 | c5 << 7);
+    dst[7] = (uint8_t)(c5 >> 1);
+    dst[8] = (uint8_t)(c5 >> 9 | c6 << 2);
+    dst[9] = (uint8_t)(c6 >> 6 | c7 << 5);
+    dst[10] = (uint8_t)(c7 >> 3);
+}
+
+/**
+ * Unpack 8 channels from OTA_GROUP_BYTES bytes, the inverse of packGroup()
+ **/
+static inline void unpackGroup(uint16_t *channels, const uint8_t *src)
+{
+    channels[0] = (src[0] | src[1] << 8) & OTA_CHANNEL_MASK;
+    channels[1] = (src[1] >> 3 | src[2] << 5) & OTA_CHANNEL_MASK;
+    channels[2] = (src[2] >> 6 | src[3] << 2 | src[4] << 10) & OTA_CHANNEL_MASK;
+    channels[3] = (src[4] >> 1 | src[5] << 7) & OTA_CHANNEL_MASK;
+    channels[4] = (src[5] >> 4 | src[6] << 4) & OTA_CHANNEL_MASK;
+    channels[5] = (src[6] >> 7 | src[7] << 1 | src[8] << 9) & OTA_CHANNEL_MASK;
+    channels[6] = (src[8] >> 2 | src[9] << 6) & OTA_CHANNEL_MASK;
+    channels[7] = (src[9] >> 5 | src[10] << 3) & OTA_CHANNEL_MASK;
+}
+
+uint8_t ICACHE_RAM_ATTR OtaPackChannels(uint8_t *dst, const uint16_t *channels, uint8_t count)
+{
+    uint8_t * const start = dst;
+    // Whole groups of 8 channels end on a byte boundary
+    for (; count >= OTA_CHANNELS_PER_GROUP; count -= OTA_CHANNELS_PER_GROUP)
+    {
+        packGroup(dst, channels);
+        dst += OTA_GROUP_BYTES;
+        channels += OTA_CHANNELS_PER_GROUP;
+    }
+
+    // Inverse of the BetaFlight bitpacker_unpack, for the remaining channels
+    uint32_t writeValue = 0;
+    uint8_t bitsMerged = 0;
+    for (uint8_t n=0; n<count; n++)
+    {
+        writeValue |= ((uint32_t)(channels[n] & OTA_CHANNEL_MASK)) << bitsMerged;
+        bitsMerged += OTA_CHANNEL_BITS;
+        while (bitsMerged >= 8)
+        {
+            *dst++ = (uint8_t)writeValue;
+            writeValue >>= 8;
+            bitsMerged -= 8;
+        }
+    }
+    if (bitsMerged > 0)
+    {
+        *dst++ = (uint8_t)writeValue;
+    }
+    return dst - start;
+}
+
+void ICACHE_RAM_ATTR OtaUnpackChannels(uint16_t *channels, const uint8_t *src, uint8_t count)
+{
+    for (; count >= OTA_CHANNELS_PER_GROUP; count -= OTA_CHANNELS_PER_GROUP)
+    {
+        unpackGroup(channels, src);
+        src += OTA_GROUP_BYTES;
+        channels += OTA_CHANNELS_PER_GROUP;
+    }
+
+    uint32_t readValue = 0;
+    uint8_t bitsMerged = 0;
+    for (uint8_t n=0; n<count; n++)
+    {
+        while (bitsMerged < OTA_CHANNEL_BITS)
+        {
+            readValue |= ((uint32_t)*src++) << bitsMerged;
+            bitsMerged += 8;
+        }
+        channels[n] = (uint16_t)(readValue & OTA_CHANNEL_MASK);
+        readValue >>= OTA_CHANNEL_BITS;
+        bitsMerged -= OTA_CHANNEL_BITS;
+    }
+}
+
+uint8_t ICACHE_RAM_ATTR OtaPackDelta(uint8_t *dst, const uint16_t *channels, const uint16_t *reference, uint8_t count)
+{
+    uint16_t changed[OTA_MAX_CHANNELS];
+    uint8_t changedCount = 0;
+    memset(dst, 0, OTA_DELTA_BITMAP_BYTES(count));
+    for (uint8_t n=0; n<count; n++)
+    {
+        const uint16_t value = channels[n] & OTA_CHANNEL_MASK;
+        if (value != reference[n])
+        {
+            dst[n / 8] |= 1 << (n % 8);
+            changed[changedCount++] = value;
+        }
+    }
+    return OTA_DELTA_BITMAP_BYTES(count) + OtaPackChannels(&dst[OTA_DELTA_BITMAP_BYTES(count)], changed, changedCount);
+}
+
+int OtaUnpackDelta(uint16_t *channels, const uint8_t *src, uint8_t srcLen, const uint16_t *reference, uint8_t count)
+{
+    const uint8_t bitmapLen = OTA_DELTA_BITMAP_BYTES(count);
+    if (srcLen < bitmapLen)
+        return -1;
+
+    uint8_t changedCount = 0;
+    for (uint8_t i=0; i<bitmapLen; i++)
+    {
+        changedCount += __builtin_popcount(src[i]);
+    }
+    const uint8_t len = bitmapLen + OTA_PACKED_BYTES(changedCount);
+    if (srcLen < len)
+        return -1;
+
+    uint16_t changed[OTA_MAX_CHANNELS];
+    OtaUnpackChannels(changed, &src[bitmapLen], changedCount);
+    uint8_t c = 0;
+    for (uint8_t n=0; n<count; n++)
+    {
+        channels[n] = (src[n / 8] & (1 << (n % 8))) ? changed[c++] : reference[n];
+    }
+    return len;
+}
+
+void ICACHE_RAM_ATTR OtaSetFrameInfo(uint8_t *frame, const ota_frame_info_t &info)
+{
+    frame[1] = (uint8_t)info.sequence;
+    frame[2] = (uint8_t)(info.sequence >> 8);
+    frame[3] = (uint8_t)info.txTimeUS;
+    frame[4] = (uint8_t)(info.txTimeUS >> 8);
+    frame[5] = (uint8_t)(info.txTimeUS >> 16);
+    frame[6] = (uint8_t)(info.txTimeUS >> 24);
+    frame[7] = (uint8_t)info.dataAgeUS;
+    frame[8] = (uint8_t)(info.dataAgeUS >> 8);
+}
+
+void OtaGetFrameInfo(const uint8_t *frame, ota_frame_info_t &info)
+{
+    info.sequence = (uint16_t)frame[1] | ((uint16_t)frame[2] << 8);
+    info.txTimeUS = (uint32_t)frame[3] | ((uint32_t)frame[4] << 8) | ((uint32_t)frame[5] << 16) | ((uint32_t)frame[6] << 24);
+    info.dataAgeUS = (uint16_t)frame[7] | ((uint16_t)frame[8] << 8);
+}
+
+uint8_t OtaBuildChannelSwitchFrame(uint8_t *frame, uint8_t wifiChannel)
+{
+    frame[0] = OTA_HEADER(OTA_FRAME_CHANNEL_SWITCH);
+    frame[OTA_HEADER_LEN] = wifiChannel;
+    return OTA_CHANNEL_SWITCH_FRAME_LEN;
+}
+
+uint8_t OtaBuildFailsafeFrame(uint8_t *frame, ota_failsafe_mode_e mode)
+{
+    frame[0] = OTA_HEADER(OTA_FRAME_FAILSAFE);
+    frame[OTA_HEADER_LEN] = mode;
+    return OTA_FAILSAFE_FRAME_LEN;
+}
+
+uint8_t OtaBuildTelemetryFrame(uint8_t *frame, const ota_telemetry_t &telemetry)
+{
+    frame[0] = OTA_HEADER(OTA_FRAME_TELEMETRY);
+    frame[1] = (uint8_t)telemetry.batteryMV;
+    frame[2] = (uint8_t)(telemetry.batteryMV >> 8);
+    frame[3] = (uint8_t)telemetry.rssiDBM;
+    frame[4] = (uint8_t)telemetry.loopTimeUS;
+    frame[5] = (uint8_t)(telemetry.loopTimeUS >> 8);
+    return OTA_TELEMETRY_FRAME_LEN;
+}
+
+bool OtaDecodeTelemetryFrame(const uint8_t *frame, uint8_t len, ota_telemetry_t &telemetry)
+{
+    if (len != OTA_TELEMETRY_FRAME_LEN || frame[0] != OTA_HEADER(OTA_FRAME_TELEMETRY))
+        return false;
+
+    telemetry.batteryMV = (uint16_t)frame[1] | ((uint16_t)frame[2] << 8);
+    telemetry.rssiDBM = (int8_t)frame[3];
+    telemetry.loopTimeUS = (uint16_t)frame[4] | ((uint16_t)frame[5] << 8);
+    return true;
+}
+
+uint8_t ICACHE_RAM_ATTR OtaBuildChannelsFrame(uint8_t *frame, const uint16_t *channels, uint8_t count)
+{
+    if (count > OTA_MAX_CHANNELS)
+        count = OTA_MAX_CHANNELS;
+    count -= count % OTA_CHANNELS_PER_GROUP;
+
+    frame[0] = OTA_HEADER(OTA_FRAME_CHANNELS);
+    return OTA_HEADER_LEN + OtaPackChannels(&frame[OTA_HEADER_LEN], channels, count);
+}
+
+/**
+ * Decode the raw little-endian uint16_t array from firmware before OTA_VERSION 1
+ * @return OTA_MAX_CHANNELS, or -1 if the frame does not have the length of one
+ **/
+static int decodeLegacyFrame(const uint8_t *frame, uint8_t len, uint16_t *channels)
+{
+    if (len != OTA_LEGACY_FRAME_LEN)
+        return -1;
+
+    for (uint8_t n=0; n<OTA_MAX_CHANNELS; n++)
+    {
+        channels[n] = (uint16_t)frame[2*n] | ((uint16_t)frame[2*n + 1] << 8);
+    }
+    return OTA_MAX_CHANNELS;
+}
+
+/**
+ * Length of an OTA_FRAME_HISTORY frame as given by its content
+ * @return the length, or -1 if the frame is cut short or the channel count is out of range
+ **/
+static int historyFrameLen(const uint8_t *frame, uint8_t len)
+{
+    const uint8_t count = (frame[OTA_HEADER_LEN] & 0x0F) * OTA_CHANNELS_PER_GROUP;
+    const uint8_t records = frame[OTA_HEADER_LEN] >> 4;
+    if (count > OTA_MAX_CHANNELS)
+        return -1;
+
+    int pos = OTA_HEADER_LEN + OTA_HISTORY_INFO_LEN + OTA_CHANNELS_BYTES(count);
+    for (uint8_t r=0; r<records; r++)
+    {
+        if (pos + OTA_DELTA_BITMAP_BYTES(count) > len)
+            return -1;
+        uint8_t changedCount = 0;
+        for (uint8_t i=0; i<OTA_DELTA_BITMAP_BYTES(count); i++)
+        {
+            changedCount += __builtin_popcount(frame[pos + i]);
+        }
+        pos += OTA_DELTA_BITMAP_BYTES(count) + OTA_PACKED_BYTES(changedCount);
+    }
+    return pos;
+}
+
+int OtaDecodeFrame(const uint8_t *frame, uint8_t len, uint16_t *channels, ota_frame_info_t *info)
+{
+    // A frame of this version may have the length of a legacy frame, e.g. a history frame with
+    // 32 channels, so the header is checked first. A legacy frame never has a matching header and
+    // length, its channel values do not exceed 11 bits.
+    if (len <= OTA_HEADER_LEN || OTA_HEADER_VERSION(frame[0]) != OTA_VERSION)
+        return decodeLegacyFrame(frame, len, channels);
+
+    if (OTA_HEADER_TYPE(frame[0]) == OTA_FRAME_CHANNELS)
+    {
+        const uint8_t payloadLen = len - OTA_HEADER_LEN;
+        if (payloadLen % OTA_GROUP_BYTES != 0 || payloadLen > OTA_CHANNELS_BYTES(OTA_MAX_CHANNELS))
+            return decodeLegacyFrame(frame, len, channels);
+
+        if (info) OtaGetFrameInfo(frame, *info);
+        const uint8_t count = payloadLen / OTA_GROUP_BYTES * OTA_CHANNELS_PER_GROUP;
+        OtaUnpackChannels(channels, &frame[OTA_HEADER_LEN], count);
+        return count;
+    }
+
+    if (OTA_HEADER_TYPE(frame[0]) == OTA_FRAME_HISTORY)
+    {
+        if (historyFrameLen(frame, len) != len)
+            return decodeLegacyFrame(frame, len, channels);
+
+        const int count = OtaDecodeHistory(frame, len, 0, channels);
+        if (count >= 0 && info) OtaGetFrameInfo(frame, *info);
+        return count;
+    }
+
+    return decodeLegacyFrame(frame, len, channels);
+}
+
+int OtaDecodeHistory(const uint8_t *frame, uint8_t len, uint8_t back, uint16_t *channels)
+{
+    if (len < OTA_HEADER_LEN + OTA_HISTORY_INFO_LEN || OTA_HEADER_VERSION(frame[0]) != OTA_VERSION ||
+        OTA_HEADER_TYPE(frame[0]) != OTA_FRAME_HISTORY)
+        return -1;
+
+    const uint8_t count = (frame[OTA_HEADER_LEN] & 0x0F) * OTA_CHANNELS_PER_GROUP;
+    const uint8_t records = frame[OTA_HEADER_LEN] >> 4;
+    if (count > OTA_MAX_CHANNELS || back > records)
+        return -1;
+
+    uint8_t pos = OTA_HEADER_LEN + OTA_HISTORY_INFO_LEN;
+    if (len < pos + OTA_CHANNELS_BYTES(count))
+        return -1;
+    OtaUnpackChannels(channels, &frame[pos], count);
+    pos += OTA_CHANNELS_BYTES(count);
+
+    // All records are encoded against the current channels, step over the newer ones
+    uint16_t current[OTA_MAX_CHANNELS];
+    memcpy(current, channels, count * sizeof(uint16_t));
+    for (uint8_t r=1; r<=back; r++)
+    {
+        const int used = OtaUnpackDelta(channels, &frame[pos], len - pos, current, count);
+        if (used < 0)
+            return -1;
+        pos += used;
+    }
+    return count;
+}
+
+uint8_t ICACHE_RAM_ATTR OtaHistoryEncoder::build(uint8_t *frame, const uint16_t *channels, uint8_t count)
+{
+    if (count > OTA_MAX_CHANNELS)
+        count = OTA_MAX_CHANNELS;
+    count -= count % OTA_CHANNELS_PER_GROUP;
+
+    // Records of a different channel count can not be encoded against this frame
+    if (count != channelCount)
+    {
+        channelCount = count;
+        historyCount = 0;
+    }
+
+    uint16_t current[OTA_MAX_CHANNELS];
+    for (uint8_t n=0; n<count; n++)
+    {
+        current[n] = channels[n] & OTA_CHANNEL_MASK;
+    }
+
+    frame[0] = OTA_HEADER(OTA_FRAME_HISTORY);
+    frame[OTA_HEADER_LEN] = (count / OTA_CHANNELS_PER_GROUP) | (historyCount << 4);
+    uint8_t len = OTA_HEADER_LEN + OTA_HISTORY_INFO_LEN;
+    len += OtaPackChannels(&frame[len], current, count);
+    for (uint8_t r=0; r<historyCount; r++)
+    {
+        const uint8_t index = (newest + OTA_MAX_HISTORY - r) % OTA_MAX_HISTORY;
+        len += OtaPackDelta(&frame[len], history[index], current, count);
+    }
+
+    if (depth > 0)
+    {
+        newest = (newest + 1) % OTA_MAX_HISTORY;
+        memcpy(history[newest], current, count * sizeof(uint16_t));
+        if (historyCount < depth)
+            historyCount++;
+    }
+    return len;
+}
+
+uint8_t ICACHE_RAM_ATTR OtaDeltaEncoder::buildKeyframe(uint8_t *frame, const uint16_t *channels, uint8_t count)
+{
+    keyframeRequested = false;
+    framesSinceKeyframe = 0;
+    keyframeId++;
+    keyframeCount = count;
+    for (uint8_t n=0; n<count; n++)
+    {
+        keyframe[n] = channels[n] & OTA_CHANNEL_MASK;
+    }
+
+    frame[0] = OTA_HEADER(OTA_FRAME_KEYFRAME);
+    frame[OTA_HEADER_LEN] = keyframeId;
+    return OTA_HEADER_LEN + OTA_KEYFRAME_ID_LEN + OtaPackChannels(&frame[OTA_HEADER_LEN + OTA_KEYFRAME_ID_LEN], keyframe, count);
+}
+
+uint8_t ICACHE_RAM_ATTR OtaDeltaEncoder::build(uint8_t *frame, const uint16_t *channels, uint8_t count)
+{
+    if (count > OTA_MAX_CHANNELS)
+        count = OTA_MAX_CHANNELS;
+    count -= count % OTA_CHANNELS_PER_GROUP;
+
+    if (keyframeRequested || count != keyframeCount || ++framesSinceKeyframe >= keyframeInterval)
+        return buildKeyframe(frame, channels, count);
+
+    const uint8_t deltaLen = OtaPackDelta(&frame[OTA_HEADER_LEN + OTA_KEYFRAME_ID_LEN], channels, keyframe, count);
+
+    // A delta which is not smaller than a full keyframe is better sent as a new keyframe
+    if (deltaLen >= OTA_CHANNELS_BYTES(count))
+        return buildKeyframe(frame, channels, count);
+
+    frame[0] = OTA_HEADER(OTA_FRAME_DELTA);
+    frame[OTA_HEADER_LEN] = keyframeId;
+    return OTA_HEADER_LEN + OTA_KEYFRAME_ID_LEN + deltaLen;
+}
+
+int OtaDeltaDecoder::decode(const uint8_t *frame, uint8_t len, uint16_t *channels, ota_frame_info_t *info)
+{
+    if (len <= OTA_HEADER_LEN + OTA_KEYFRAME_ID_LEN || OTA_HEADER_VERSION(frame[0]) != OTA_VERSION)
+        return OtaDecodeFrame(frame, len, channels, info);
+
+    const uint8_t type = OTA_HEADER_TYPE(frame[0]);
+    const uint8_t id = frame[OTA_HEADER_LEN];
+    const uint8_t *payload = &frame[OTA_HEADER_LEN + OTA_KEYFRAME_ID_LEN];
+    const uint8_t payloadLen = len - OTA_HEADER_LEN - OTA_KEYFRAME_ID_LEN;
+
+    if (type == OTA_FRAME_KEYFRAME)
+    {
+        if (payloadLen % OTA_GROUP_BYTES != 0 || payloadLen > OTA_CHANNELS_BYTES(OTA_MAX_CHANNELS))
+            return OtaDecodeFrame(frame, len, channels, info);
+
+        if (info) OtaGetFrameInfo(frame, *info);
+        keyframeCount = payloadLen / OTA_GROUP_BYTES * OTA_CHANNELS_PER_GROUP;
+        keyframeId = id;
+        OtaUnpackChannels(keyframe, payload, keyframeCount);
+        memcpy(channels, keyframe, keyframeCount * sizeof(uint16_t));
+        return keyframeCount;
+    }
+
+    if (type == OTA_FRAME_DELTA)
+    {
+        // No delta is as long as a legacy frame
+        if (len == OTA_LEGACY_FRAME_LEN)
+            return OtaDecodeFrame(frame, len, channels, info);
+
+        if (keyframeCount == 0 || id != keyframeId)
+        {
+            // The keyframe this delta refers to was lost, wait for the next one
+            missingKeyframeCount++;
+            return -1;
+        }
+
+        if (OtaUnpackDelta(channels, payload, payloadLen, keyframe, keyframeCount) != payloadLen)
+            return -1;
+        if (info) OtaGetFrameInfo(frame, *info);
+        return keyframeCount;
+    }
+
+    return OtaDecodeFrame(frame, len, channels, info);
+}
+
+bool OtaSequenceTracker::update(uint16_t sequence, uint32_t txTimeUS)
+{
+    const int16_t diff = (int16_t)(sequence - lastSequence);
+    const uint32_t sentBeforeUS = lastTxTimeUS - txTimeUS;
+    const bool restarted = synced && (diff <= -OTA_SEQUENCE_RESYNC_WINDOW ||
+                                      (sentBeforeUS > OTA_SEQUENCE_LATE_US && (diff <= 0 || (int32_t)sentBeforeUS > 0)));
+    if (restarted)
+    {
+        // Follow the new sequence right away, instead of dropping its frames as late
+        restartCount++;
+    }
+    else if (synced && diff <= 0)
+    {
+        lateCount++;
+        return false;
+    }
+    else if (synced)
+    {
+        lostCount += diff - 1;
+    }
+    synced = true;
+    lastSequence = sequence;
+    lastTxTimeUS = txTimeUS;
+    receivedCount++;
+    return true;
+}
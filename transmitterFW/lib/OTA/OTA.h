@@ -0,0 +1,361 @@
+/*
+ * This file belongs to the CyberBrick ESP-NOW transmitter & receiver project, hosted originally at:
+ * https://github.com/rotorman/CyberBrick_ESPNOW
+ * Copyright (C) 2025, Risto Kõiva
+ *
+ * License GPL-3.0: https://www.gnu.org/licenses/gpl-3.0.html
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#ifndef ICACHE_RAM_ATTR
+#define ICACHE_RAM_ATTR
+#endif
+
+/*
+ * Over-the-air (ESP-NOW) frame format between the transmitter and the CyberBrick receivers.
+ *
+ * Every frame starts with a 9 byte header, all multi-byte values are little-endian:
+ *   [version/type][sequence (2)][TX timestamp (4)][data age (2)]
+ *   version/type: format version in the upper and the frame type in the lower nibble
+ *   sequence:     counts up by one with every frame sent to the receiver, to detect lost,
+ *                 duplicated and reordered frames
+ *   TX timestamp: micros() of the transmitter when the frame was handed to ESP-NOW
+ *   data age:     time from the reception of the channels from the handset to the TX timestamp
+ *                 in microseconds, saturating at 65535
+ *
+ * OTA_FRAME_CHANNELS:
+ *   [header][ch1..ch8 (11 bytes)][ch9..ch16 (11 bytes)] ... up to 4 groups (32 channels)
+ *   Channels are packed as 11 bits each, in the same little-endian bit order as the
+ *   CRSF RC channels packet payload (crsf_channels_t). The channel count is given by the
+ *   frame length, 16 channels take 23 bytes and 32 channels 45 bytes over the air.
+ *
+ * OTA_FRAME_KEYFRAME:
+ *   [header][keyframe id][channels, packed as in OTA_FRAME_CHANNELS]
+ *   Full channel set, which the following OTA_FRAME_DELTA frames refer to.
+ *
+ * OTA_FRAME_DELTA:
+ *   [header][keyframe id][changed bitmap][changed channels, 11 bits each, padded to a full byte]
+ *   The bitmap holds one bit per keyframe channel (LSB of the first byte is ch1) and only the
+ *   channels differing from keyframe <id> follow, in ascending order. Deltas always refer to
+ *   the last keyframe and never to the previous delta, so a lost delta frame does not affect
+ *   any later frame. A receiver which missed the keyframe drops deltas until the next one.
+ *
+ * OTA_FRAME_HISTORY:
+ *   [header][groups/records][channels, packed as in OTA_FRAME_CHANNELS][record 1]...[record N]
+ *   groups/records: number of 8 channel groups in the lower and number of records in the upper nibble
+ *   Full channel set, followed by the channels of the N previous frames sent to the receiver, newest
+ *   first. Each record holds the channels of one previous frame, encoded like the OTA_FRAME_DELTA
+ *   payload ([changed bitmap][changed channels]) against the channels of this frame. A receiver
+ *   can rebuild up to N lost frames from the next frame which arrives.
+ *
+ * OTA_FRAME_CHANNEL_SWITCH:
+ *   [header][WiFi channel]
+ *   Sent instead of the channels while the transmitter moves to a quieter WiFi channel. The receiver
+ *   follows right away, the transmitter once all receivers acknowledged the frame. A receiver which
+ *   does not find the transmitter on the new channel returns to its configured channel.
+ *
+ * OTA_FRAME_FAILSAFE:
+ *   [header][failsafe mode]
+ *   Sent instead of the channels as soon as the transmitter lost the channels from the handset,
+ *   first as a short burst and then with every packet interval until the handset is back.
+ *   failsafe mode: ota_failsafe_mode_e, the receiver holds its outputs, moves all channels to
+ *   their center or cuts its outputs as it does when it loses the transmitter.
+ *
+ * OTA_FRAME_TELEMETRY, from a receiver to the transmitter:
+ *   [version/type][battery voltage (2)][RSSI (1)][loop time (2)]
+ *   Only the first header byte is used. Battery voltage in mV (0 if not measured), RSSI of the
+ *   frames from the transmitter in dBm (signed) and the longest main loop time of the receiver
+ *   since its last telemetry frame in microseconds, saturating at 65535.
+ *
+ * Firmware before OTA_VERSION 1 sent the raw uint16_t ChannelData[32] array (64 bytes)
+ * without any header. OTA_VERSION 1 had only the version/type header byte.
+ */
+
+#define OTA_VERSION 2
+
+#define OTA_CHANNEL_BITS 11
+#define OTA_CHANNEL_MASK ((1 << OTA_CHANNEL_BITS) - 1)
+#define OTA_CHANNELS_PER_GROUP 8
+#define OTA_GROUP_BYTES (OTA_CHANNELS_PER_GROUP * OTA_CHANNEL_BITS / 8)
+#define OTA_MAX_CHANNELS 32
+#define OTA_CHANNELS_BYTES(count) ((count) / OTA_CHANNELS_PER_GROUP * OTA_GROUP_BYTES)
+
+#define OTA_HEADER_LEN 9
+#define OTA_KEYFRAME_ID_LEN 1
+#define OTA_HISTORY_INFO_LEN 1
+#define OTA_MAX_HISTORY 3 // records, limited by the ESP-NOW payload size of 250 bytes
+
+#define OTA_PACKED_BYTES(count) (((count) * OTA_CHANNEL_BITS + 7) / 8)
+#define OTA_DELTA_BITMAP_BYTES(count) ((count) / 8)
+#define OTA_HISTORY_RECORD_MAX_LEN (OTA_DELTA_BITMAP_BYTES(OTA_MAX_CHANNELS) + OTA_CHANNELS_BYTES(OTA_MAX_CHANNELS))
+
+#define OTA_MAX_FRAME_LEN (OTA_HEADER_LEN + OTA_HISTORY_INFO_LEN + OTA_CHANNELS_BYTES(OTA_MAX_CHANNELS) + OTA_MAX_HISTORY * OTA_HISTORY_RECORD_MAX_LEN)
+
+#if !defined(OTA_KEYFRAME_INTERVAL)
+#define OTA_KEYFRAME_INTERVAL 10 // frames
+#endif
+
+#if !defined(OTA_HISTORY_DEPTH)
+#define OTA_HISTORY_DEPTH 2 // records, up to OTA_MAX_HISTORY
+#endif
+
+#define OTA_LEGACY_FRAME_LEN 64
+#define OTA_TELEMETRY_FRAME_LEN 6
+#define OTA_CHANNEL_SWITCH_FRAME_LEN (OTA_HEADER_LEN + 1)
+#define OTA_FAILSAFE_FRAME_LEN (OTA_HEADER_LEN + 1)
+
+typedef enum : uint8_t
+{
+    OTA_FRAME_CHANNELS = 0x0,
+    OTA_FRAME_KEYFRAME = 0x1,
+    OTA_FRAME_DELTA = 0x2,
+    OTA_FRAME_HISTORY = 0x3,
+    OTA_FRAME_CHANNEL_SWITCH = 0x4,
+    OTA_FRAME_FAILSAFE = 0x5,
+    OTA_FRAME_TELEMETRY = 0x8,
+} ota_frame_type_e;
+
+typedef enum : uint8_t
+{
+    OTA_FAILSAFE_HOLD = 0,    // keep the last channels
+    OTA_FAILSAFE_NEUTRAL = 1, // all channels to their center
+    OTA_FAILSAFE_CUT = 2,     // outputs off, as on the loss of the transmitter
+    OTA_FAILSAFE_MODE_COUNT
+} ota_failsafe_mode_e;
+
+#define OTA_HEADER(type) ((uint8_t)((OTA_VERSION << 4) | (type)))
+#define OTA_HEADER_VERSION(header) ((uint8_t)(header) >> 4)
+#define OTA_HEADER_TYPE(header) ((uint8_t)(header) & 0x0F)
+
+#define OTA_DATA_AGE_MAX 0xFFFF
+
+// Frames older than this many sequence numbers are dropped as late, anything further
+// back means the transmitter restarted and the sequence is followed from there
+#define OTA_SEQUENCE_RESYNC_WINDOW 256
+// Late frames were sent at most this long before the last frame. A frame with an older sequence
+// number, but sent later or much earlier, comes from a transmitter which restarted.
+#define OTA_SEQUENCE_LATE_US 200000
+
+typedef struct
+{
+    uint16_t sequence;
+    uint32_t txTimeUS;
+    uint16_t dataAgeUS;
+} ota_frame_info_t;
+
+typedef struct
+{
+    uint16_t batteryMV;
+    int8_t rssiDBM;
+    uint16_t loopTimeUS;
+} ota_telemetry_t;
+
+/**
+ * @brief Build an OTA_FRAME_CHANNEL_SWITCH frame
+ * @param frame buffer of at least OTA_CHANNEL_SWITCH_FRAME_LEN bytes
+ * @param wifiChannel the WiFi channel the receiver is to move to
+ * @return the length of the frame in bytes
+ */
+uint8_t OtaBuildChannelSwitchFrame(uint8_t *frame, uint8_t wifiChannel);
+
+/**
+ * @brief Build an OTA_FRAME_FAILSAFE frame
+ * @param frame buffer of at least OTA_FAILSAFE_FRAME_LEN bytes
+ * @return the length of the frame in bytes
+ */
+uint8_t OtaBuildFailsafeFrame(uint8_t *frame, ota_failsafe_mode_e mode);
+
+/**
+ * @brief Build an OTA_FRAME_TELEMETRY frame, as sent by the receivers
+ * @param frame buffer of at least OTA_TELEMETRY_FRAME_LEN bytes
+ * @return the length of the frame in bytes
+ */
+uint8_t OtaBuildTelemetryFrame(uint8_t *frame, const ota_telemetry_t &telemetry);
+
+/**
+ * @return true if the frame is a valid OTA_FRAME_TELEMETRY frame, which was decoded into telemetry
+ */
+bool OtaDecodeTelemetryFrame(const uint8_t *frame, uint8_t len, ota_telemetry_t &telemetry);
+
+/**
+ * @brief Fill in the sequence number, TX timestamp and data age of a built frame
+ * @param frame frame from one of the Ota*Build functions, the version/type byte is kept
+ */
+void OtaSetFrameInfo(uint8_t *frame, const ota_frame_info_t &info);
+
+/**
+ * @brief Read the sequence number, TX timestamp and data age from the frame header
+ */
+void OtaGetFrameInfo(const uint8_t *frame, ota_frame_info_t &info);
+
+/**
+ * @brief Pack channels 11 bits each, in CRSF bit order
+ * @param dst buffer receiving OTA_PACKED_BYTES(count) bytes, the last byte is zero padded
+ * @param channels channel values, only the lower 11 bits are used
+ * @param count number of channels
+ * @return the number of bytes written
+ */
+uint8_t OtaPackChannels(uint8_t *dst, const uint16_t *channels, uint8_t count);
+
+/**
+ * @brief Unpack 11-bit channels, the inverse of OtaPackChannels()
+ */
+void OtaUnpackChannels(uint16_t *channels, const uint8_t *src, uint8_t count);
+
+/**
+ * @brief Pack the channels differing from reference as [changed bitmap][changed channels]
+ * @param dst buffer receiving up to OTA_DELTA_BITMAP_BYTES(count) + OTA_CHANNELS_BYTES(count) bytes
+ * @param reference channel values to compare with, already masked to 11 bits
+ * @param count number of channels, a multiple of OTA_CHANNELS_PER_GROUP
+ * @return the number of bytes written
+ */
+uint8_t OtaPackDelta(uint8_t *dst, const uint16_t *channels, const uint16_t *reference, uint8_t count);
+
+/**
+ * @brief Unpack channels packed by OtaPackDelta()
+ * @param srcLen number of bytes available at src
+ * @return the number of bytes used, or -1 if srcLen is too short
+ */
+int OtaUnpackDelta(uint16_t *channels, const uint8_t *src, uint8_t srcLen, const uint16_t *reference, uint8_t count);
+
+/**
+ * @brief Build an OTA_FRAME_CHANNELS frame, the header is completed by OtaSetFrameInfo()
+ * @param frame buffer of at least OTA_MAX_FRAME_LEN bytes
+ * @param count number of channels, rounded down to a multiple of OTA_CHANNELS_PER_GROUP
+ * @return the length of the frame in bytes
+ */
+uint8_t OtaBuildChannelsFrame(uint8_t *frame, const uint16_t *channels, uint8_t count);
+
+/**
+ * @brief Reference decoder for frames received over-the-air, including the legacy raw format
+ * @param channels receives up to OTA_MAX_CHANNELS channel values
+ * @param info receives the header fields, if not nullptr. Left unchanged for legacy frames.
+ * @return the number of channels decoded, or -1 if the frame is not a valid channels frame
+ */
+int OtaDecodeFrame(const uint8_t *frame, uint8_t len, uint16_t *channels, ota_frame_info_t *info = nullptr);
+
+/**
+ * @brief Rebuild the channels of a previous frame from an OTA_FRAME_HISTORY frame
+ * @param back 1 for the frame before this one (sequence - 1) and so on
+ * @param channels receives up to OTA_MAX_CHANNELS channel values
+ * @return the number of channels decoded, or -1 if the frame does not hold that record
+ */
+int OtaDecodeHistory(const uint8_t *frame, uint8_t len, uint8_t back, uint16_t *channels);
+
+/**
+ * @brief Builds OTA_FRAME_KEYFRAME and OTA_FRAME_DELTA frames for one receiver
+ */
+class OtaDeltaEncoder
+{
+public:
+    explicit OtaDeltaEncoder(uint8_t keyframeInterval = OTA_KEYFRAME_INTERVAL) : keyframeInterval(keyframeInterval) {}
+
+    /**
+     * @brief Build the next frame, a keyframe every keyframeInterval frames, when requested,
+     * when the channel count changes or when a delta would not be smaller than a keyframe
+     * @param frame buffer of at least OTA_MAX_FRAME_LEN bytes
+     * @return the length of the frame in bytes
+     */
+    uint8_t build(uint8_t *frame, const uint16_t *channels, uint8_t count);
+
+    /**
+     * @brief Send a keyframe with the next frame, e.g. after switching to another receiver
+     */
+    void requestKeyframe() { keyframeRequested = true; }
+
+private:
+    uint8_t buildKeyframe(uint8_t *frame, const uint16_t *channels, uint8_t count);
+
+    uint16_t keyframe[OTA_MAX_CHANNELS] = {0};
+    uint8_t keyframeCount = 0;
+    uint8_t keyframeId = 0;
+    uint8_t keyframeInterval;
+    uint8_t framesSinceKeyframe = 0;
+    volatile bool keyframeRequested = true;
+};
+
+/**
+ * @brief Builds OTA_FRAME_HISTORY frames for one receiver
+ */
+class OtaHistoryEncoder
+{
+public:
+    explicit OtaHistoryEncoder(uint8_t depth = OTA_HISTORY_DEPTH) : depth(depth < OTA_MAX_HISTORY ? depth : OTA_MAX_HISTORY) {}
+
+    /**
+     * @brief Build the next frame, holding up to depth records of the previously built frames
+     * @param frame buffer of at least OTA_MAX_FRAME_LEN bytes
+     * @return the length of the frame in bytes
+     */
+    uint8_t build(uint8_t *frame, const uint16_t *channels, uint8_t count);
+
+private:
+    uint16_t history[OTA_MAX_HISTORY][OTA_MAX_CHANNELS] = {{0}};
+    uint8_t historyCount = 0; // number of valid entries in history
+    uint8_t newest = 0;       // index of the previous frame in history
+    uint8_t channelCount = 0;
+    uint8_t depth;
+};
+
+/**
+ * @brief Reference decoder for all channel frame types, keeping the keyframe state of one receiver
+ */
+class OtaDeltaDecoder
+{
+public:
+    /**
+     * @param channels receives up to OTA_MAX_CHANNELS channel values
+     * @param info receives the header fields, if not nullptr
+     * @return the number of channels decoded, or -1 if the frame is not a valid channels frame
+     * or refers to a keyframe which was not received
+     */
+    int decode(const uint8_t *frame, uint8_t len, uint16_t *channels, ota_frame_info_t *info = nullptr);
+
+    uint32_t GetMissingKeyframeCount() const { return missingKeyframeCount; }
+
+private:
+    uint16_t keyframe[OTA_MAX_CHANNELS] = {0};
+    uint8_t keyframeCount = 0; // 0 until the first keyframe has been received
+    uint8_t keyframeId = 0;
+    uint32_t missingKeyframeCount = 0;
+};
+
+/**
+ * @brief Follows the sequence numbers received from one transmitter to count lost and late frames
+ */
+class OtaSequenceTracker
+{
+public:
+    /**
+     * @param txTimeUS TX timestamp of the frame, to tell a restart of the transmitter from a late frame
+     * @return false if the frame is a duplicate or arrived after a newer one and should be dropped
+     */
+    bool update(uint16_t sequence, uint32_t txTimeUS);
+
+    uint32_t GetReceivedCount() const { return receivedCount; }
+    uint32_t GetLostCount() const { return lostCount; }
+    uint32_t GetLateCount() const { return lateCount; }
+    uint32_t GetRestartCount() const { return restartCount; }
+
+private:
+    uint16_t lastSequence = 0;
+    uint32_t lastTxTimeUS = 0;
+    bool synced = false;
+    uint32_t receivedCount = 0;
+    uint32_t lostCount = 0; // gaps in the sequence, including frames which arrived late later on
+    uint32_t lateCount = 0; // duplicated or reordered frames
+    uint32_t restartCount = 0; // the sequence started over, after a restart of the transmitter
+};
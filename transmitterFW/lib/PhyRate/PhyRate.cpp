@@ -0,0 +1,228 @@
+/*
+ * This file belongs to the CyberBrick ESP-NOW transmitter & receiver project, hosted originally at:
+ * https://github.com/rotorman/CyberBrick_ESPNOW
+ * Copyright (C) 2025, Risto Kõiva
+ *
+ * License GPL-3.0: https://www.gnu.org/licenses/gpl-3.0.html
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "PhyRate.h"
+
+typedef enum : uint8_t
+{
+    MODULATION_DSSS, // 802.11b and LR, long preamble
+    MODULATION_OFDM, // 802.11g
+    MODULATION_HT    // 802.11n HT20 mixed mode, long guard interval
+} phyModulation_e;
+
+typedef struct
+{
+    wifi_phy_mode_t mode;
+    wifi_phy_rate_t rate;
+    uint16_t rate10k;        // data rate in 10 kbps
+    phyModulation_e modulation;
+    phyProfile_e ackProfile; // the receiver acknowledges with a basic rate
+} phyProfile_t;
+
+static const phyProfile_t phyProfiles[PHY_PROFILE_COUNT] = {
+    {WIFI_PHY_MODE_11B,  WIFI_PHY_RATE_1M_L,      100,  MODULATION_DSSS, PHY_1M_11B},
+    {WIFI_PHY_MODE_11B,  WIFI_PHY_RATE_2M_L,      200,  MODULATION_DSSS, PHY_2M_11B},
+    {WIFI_PHY_MODE_11B,  WIFI_PHY_RATE_11M_L,     1100, MODULATION_DSSS, PHY_2M_11B},
+    {WIFI_PHY_MODE_11G,  WIFI_PHY_RATE_6M,        600,  MODULATION_OFDM, PHY_6M_11G},
+    {WIFI_PHY_MODE_11G,  WIFI_PHY_RATE_12M,       1200, MODULATION_OFDM, PHY_12M_11G},
+    {WIFI_PHY_MODE_11G,  WIFI_PHY_RATE_24M,       2400, MODULATION_OFDM, PHY_24M_11G},
+    {WIFI_PHY_MODE_11G,  WIFI_PHY_RATE_54M,       5400, MODULATION_OFDM, PHY_24M_11G},
+    {WIFI_PHY_MODE_HT20, WIFI_PHY_RATE_MCS0_LGI,  650,  MODULATION_HT,   PHY_6M_11G},
+    {WIFI_PHY_MODE_HT20, WIFI_PHY_RATE_MCS3_LGI,  2600, MODULATION_HT,   PHY_24M_11G},
+    {WIFI_PHY_MODE_HT20, WIFI_PHY_RATE_MCS7_LGI,  6500, MODULATION_HT,   PHY_24M_11G},
+    {WIFI_PHY_MODE_LR,   WIFI_PHY_RATE_LORA_500K, 50,   MODULATION_DSSS, PHY_LR_500K},
+    {WIFI_PHY_MODE_LR,   WIFI_PHY_RATE_LORA_250K, 25,   MODULATION_DSSS, PHY_LR_250K},
+};
+
+// Profiles the adaptive rate control moves along, from the most robust to the fastest
+static const phyProfile_e phyLadder[] = {PHY_1M_11B, PHY_2M_11B, PHY_6M_11G, PHY_12M_11G, PHY_24M_11G};
+static constexpr uint8_t PHY_LADDER_STEPS = sizeof(phyLadder) / sizeof(phyLadder[0]);
+
+// 802.11 MAC header (24), action category (1), Espressif OUI (3), random value (4),
+// vendor specific element header (7) and FCS (4)
+static constexpr uint8_t ESPNOW_FRAME_OVERHEAD = 43;
+static constexpr uint8_t ACK_FRAME_LEN = 14;
+static constexpr uint32_t SIFS_US = 10;
+
+esp_now_rate_config_t PhyRateConfig(phyProfile_e profile)
+{
+    esp_now_rate_config_t config = {};
+    config.phymode = phyProfiles[profile].mode;
+    config.rate = phyProfiles[profile].rate;
+    config.ersu = false;
+    config.dcm = false;
+    return config;
+}
+
+/**
+ * Duration of a single PPDU of len bytes on air, including the preamble
+ **/
+static uint32_t frameDurationUS(const phyProfile_t &p, uint16_t len)
+{
+    const uint32_t bits = len * 8U;
+    switch (p.modulation)
+    {
+    case MODULATION_DSSS:
+        return 192 + (bits * 100 + p.rate10k - 1) / p.rate10k;
+    case MODULATION_OFDM:
+    case MODULATION_HT:
+    {
+        // 4 us symbols carrying service (16) and tail (6) bits in addition to the data
+        const uint32_t bitsPerSymbol10k = p.rate10k * 4;
+        const uint32_t symbols = ((16 + bits + 6) * 100 + bitsPerSymbol10k - 1) / bitsPerSymbol10k;
+        const uint32_t preamble = (p.modulation == MODULATION_OFDM) ? 20 : 36;
+        return preamble + symbols * 4 + 6; // 6 us signal extension in the 2.4 GHz band
+    }
+    }
+    return 0;
+}
+
+uint32_t PhyAirtimeUS(phyProfile_e profile, uint8_t payloadLen)
+{
+    const phyProfile_t &p = phyProfiles[profile];
+    return frameDurationUS(p, payloadLen + ESPNOW_FRAME_OVERHEAD) + SIFS_US +
+           frameDurationUS(phyProfiles[p.ackProfile], ACK_FRAME_LEN);
+}
+
+uint32_t PhyFrameAirtimeUS(wifi_phy_rate_t rate, uint16_t len)
+{
+    phyProfile_t p = {WIFI_PHY_MODE_11G, rate, 0, MODULATION_OFDM, PHY_6M_11G};
+    switch (rate)
+    {
+    case WIFI_PHY_RATE_1M_L:  p.rate10k = 100;  p.modulation = MODULATION_DSSS; break;
+    case WIFI_PHY_RATE_2M_L:  p.rate10k = 200;  p.modulation = MODULATION_DSSS; break;
+    case WIFI_PHY_RATE_5M_L:  p.rate10k = 550;  p.modulation = MODULATION_DSSS; break;
+    case WIFI_PHY_RATE_11M_L: p.rate10k = 1100; p.modulation = MODULATION_DSSS; break;
+    case WIFI_PHY_RATE_6M:    p.rate10k = 600;  break;
+    case WIFI_PHY_RATE_9M:    p.rate10k = 900;  break;
+    case WIFI_PHY_RATE_12M:   p.rate10k = 1200; break;
+    case WIFI_PHY_RATE_18M:   p.rate10k = 1800; break;
+    case WIFI_PHY_RATE_24M:   p.rate10k = 2400; break;
+    case WIFI_PHY_RATE_36M:   p.rate10k = 3600; break;
+    case WIFI_PHY_RATE_48M:   p.rate10k = 4800; break;
+    case WIFI_PHY_RATE_54M:   p.rate10k = 5400; break;
+    default:
+        if (rate >= WIFI_PHY_RATE_MCS0_LGI && rate <= WIFI_PHY_RATE_MCS7_LGI)
+        {
+            static const uint16_t mcsRate10k[] = {650, 1300, 1950, 2600, 3900, 5200, 5850, 6500};
+            p.rate10k = mcsRate10k[rate - WIFI_PHY_RATE_MCS0_LGI];
+            p.modulation = MODULATION_HT;
+        }
+        else
+        {
+            p.rate10k = 100; // unknown rate, assume the slowest
+            p.modulation = MODULATION_DSSS;
+        }
+        break;
+    }
+    return frameDurationUS(p, len);
+}
+
+void PhyRateController::applySetting(phyProfile_e newProfile, bool newAdaptive)
+{
+    adaptive = newAdaptive;
+    probing = false;
+    results = 0;
+    failures = 0;
+    cleanWindows = 0;
+    holdoffWindows = PHY_RATE_HOLDOFF_MIN;
+    ladderStep = 0;
+    if (adaptive)
+    {
+        // Start from the requested profile if it is on the ladder, otherwise from the most robust one
+        for (uint8_t step = 0; step < PHY_LADDER_STEPS; step++)
+        {
+            if (phyLadder[step] == newProfile)
+                ladderStep = step;
+        }
+        newProfile = phyLadder[ladderStep];
+    }
+    profile.store(newProfile, std::memory_order_relaxed);
+    changed.store(true, std::memory_order_release);
+}
+
+void PhyRateController::setLadderStep(uint8_t step)
+{
+    probing = step > ladderStep;
+    ladderStep = step;
+    results = 0;
+    failures = 0;
+    cleanWindows = 0;
+    profile.store(phyLadder[step], std::memory_order_relaxed);
+    changed.store(true, std::memory_order_release);
+}
+
+void PhyRateController::addResult(bool success)
+{
+    const uint8_t setting = pendingSetting.exchange(0, std::memory_order_acquire);
+    if (setting != 0)
+    {
+        // This frame went out with the previous setting and does not count
+        applySetting((phyProfile_e)((setting & ~PENDING_ADAPTIVE) - 1), (setting & PENDING_ADAPTIVE) != 0);
+        return;
+    }
+    if (!adaptive)
+        return;
+
+    results++;
+    if (!success)
+        failures++;
+
+    if (failures >= PHY_RATE_DOWN_FAILURES)
+    {
+        if (probing && holdoffWindows < PHY_RATE_HOLDOFF_MAX)
+            holdoffWindows *= 2; // the faster profile does not work here, try it again less often
+        if (ladderStep > 0)
+            setLadderStep(ladderStep - 1);
+        else
+            results = failures = 0;
+        return;
+    }
+
+    if (results < PHY_RATE_WINDOW)
+        return;
+
+    if (failures <= PHY_RATE_UP_MAX_FAILURES)
+    {
+        if (probing)
+        {
+            probing = false;
+            if (holdoffWindows > PHY_RATE_HOLDOFF_MIN)
+                holdoffWindows /= 2;
+        }
+        if (++cleanWindows >= holdoffWindows && ladderStep + 1 < PHY_LADDER_STEPS)
+        {
+            setLadderStep(ladderStep + 1);
+            return;
+        }
+    }
+    else
+    {
+        cleanWindows = 0;
+    }
+    results = 0;
+    failures = 0;
+}
+
+bool PhyRateController::takeChange(phyProfile_e &newProfile)
+{
+    if (!changed.exchange(false, std::memory_order_acquire))
+        return false;
+    newProfile = getProfile();
+    return true;
+}
@@ -0,0 +1,138 @@
+/*
+ * This file belongs to the CyberBrick ESP-NOW transmitter & receiver project, hosted originally at:
+ * https://github.com/rotorman/CyberBrick_ESPNOW
+ * Copyright (C) 2025, Risto Kõiva
+ *
+ * License GPL-3.0: https://www.gnu.org/licenses/gpl-3.0.html
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include <esp_now.h>
+
+/*
+ * PHY rate profiles for the ESP-NOW frames to a receiver.
+ *
+ * ESP-NOW sends with 802.11b 1 Mbps by default, where a 53 byte OTA frame occupies the channel
+ * for about 1 ms including the acknowledgement. The faster profiles need a better signal, but
+ * shorten the airtime, so that more models can share one WiFi channel. The Long Range (LR) profiles
+ * are an Espressif extension and are only received by ESP32 receivers with the LR protocol enabled.
+ */
+typedef enum : uint8_t
+{
+    PHY_1M_11B = 0,
+    PHY_2M_11B,
+    PHY_11M_11B,
+    PHY_6M_11G,
+    PHY_12M_11G,
+    PHY_24M_11G,
+    PHY_54M_11G,
+    PHY_MCS0_HT20,
+    PHY_MCS3_HT20,
+    PHY_MCS7_HT20,
+    PHY_LR_500K,
+    PHY_LR_250K,
+    PHY_PROFILE_COUNT
+} phyProfile_e;
+
+#define PHY_RATE_WINDOW 50           // send results per evaluation window of the adaptive rate control
+#define PHY_RATE_DOWN_FAILURES 5     // failed sends within a window which step the rate down at once
+#define PHY_RATE_UP_MAX_FAILURES 1   // a window with up to this many failed sends counts as clean
+#define PHY_RATE_HOLDOFF_MIN 2       // clean windows before probing the next faster profile
+#define PHY_RATE_HOLDOFF_MAX 32
+
+/**
+ * @return the rate configuration for esp_now_set_peer_rate_config()
+ */
+esp_now_rate_config_t PhyRateConfig(phyProfile_e profile);
+
+/**
+ * @brief Estimate the time a frame occupies the channel
+ *
+ * Includes the ESP-NOW vendor action frame overhead, the PHY preamble and the acknowledgement
+ * of the receiver, but no retries or channel access backoff.
+ * @param payloadLen length of the ESP-NOW payload in bytes
+ * @return airtime in microseconds
+ */
+uint32_t PhyAirtimeUS(phyProfile_e profile, uint8_t payloadLen);
+
+/**
+ * @brief Estimate the time a received frame occupied the channel, without any acknowledgement
+ * @param rate the rate reported for the frame, WIFI_PHY_RATE_MCS0_LGI plus the MCS index for HT frames
+ * @param len length of the frame in bytes, including the FCS
+ * @return airtime in microseconds
+ */
+uint32_t PhyFrameAirtimeUS(wifi_phy_rate_t rate, uint16_t len);
+
+/**
+ * @brief Adaptive PHY rate selection for one receiver, driven by the ESP-NOW send results
+ *
+ * In adaptive mode the rate moves along a ladder of increasingly fast profiles
+ * (1 and 2 Mbps 11b, 6, 12 and 24 Mbps 11g). PHY_RATE_DOWN_FAILURES failed sends within one
+ * window of PHY_RATE_WINDOW results step down at once. After a number of clean windows the next
+ * faster profile is probed. If the probe fails right away, the number of clean windows required
+ * before the next probe doubles, so that a marginal link does not keep toggling between two rates.
+ *
+ * addResult() is called from the ESP-NOW send callback, takeChange() from the task calling
+ * esp_now_send(), which applies the new profile to the peer. setProfile() may be called from any
+ * task, the rate control state is only changed by addResult(), which picks the new setting up.
+ */
+class PhyRateController
+{
+public:
+    /**
+     * @brief Use a fixed profile, or start the adaptive rate control at the given profile if it is on
+     * the ladder, otherwise at the most robust one
+     *
+     * Takes effect with the next send result.
+     */
+    void setProfile(phyProfile_e profile, bool adaptive)
+    {
+        pendingSetting.store((adaptive ? PENDING_ADAPTIVE : 0) | (profile + 1), std::memory_order_release);
+    }
+
+    /**
+     * @brief Add the result of a send, from the ESP-NOW send callback
+     */
+    void addResult(bool success);
+
+    /**
+     * @brief Check for a profile change which is not yet applied to the peer
+     * @param profile receives the new profile
+     * @return true once per change
+     */
+    bool takeChange(phyProfile_e &profile);
+
+    phyProfile_e getProfile() const { return (phyProfile_e)profile.load(std::memory_order_relaxed); }
+    bool isAdaptive() const { return adaptive; }
+
+private:
+    static constexpr uint8_t PENDING_ADAPTIVE = 0x80;
+
+    void applySetting(phyProfile_e profile, bool adaptive);
+    void setLadderStep(uint8_t step);
+
+    std::atomic<uint8_t> pendingSetting {0}; // profile + 1 | PENDING_ADAPTIVE, 0 if there is none
+
+    std::atomic<uint8_t> profile {PHY_1M_11B};
+    std::atomic<bool> changed {false};
+    bool adaptive = false;
+    bool probing = false;      // stepped up and not yet confirmed by a clean window
+    uint8_t ladderStep = 0;
+    uint8_t results = 0;       // results in the current window
+    uint8_t failures = 0;      // failed sends in the current window
+    uint8_t cleanWindows = 0;  // consecutive clean windows on the current step
+    uint8_t holdoffWindows = 0;
+};
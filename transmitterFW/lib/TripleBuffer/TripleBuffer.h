@@ -0,0 +1,84 @@
+/*
+ * This file belongs to the CyberBrick ESP-NOW transmitter & receiver project, hosted originally at:
+ * https://github.com/rotorman/CyberBrick_ESPNOW
+ * Copyright (C) 2025, Risto Kõiva
+ *
+ * License GPL-3.0: https://www.gnu.org/licenses/gpl-3.0.html
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+#ifndef ICACHE_RAM_ATTR
+#define ICACHE_RAM_ATTR
+#endif
+
+/**
+ * @brief Lock-free triple buffer for handing over a complete value from one writer to one reader.
+ *
+ * The writer fills writeBuffer() and publishes it as a whole with publish(). The reader calls
+ * read(), which returns the newest published value. Each side owns one of the three buffers, the
+ * third one is swapped atomically with the middle slot, so the reader never sees a partially
+ * written value and neither side ever waits for the other. Values published in between two reads
+ * are skipped.
+ *
+ * Only a single writer and a single reader task are allowed.
+ *
+ * @tparam T type of the value, copied by the caller into writeBuffer()
+ */
+template <typename T>
+class TripleBuffer
+{
+public:
+    /**
+     * @brief Buffer owned by the writer, valid until the next publish()
+     */
+    ICACHE_RAM_ATTR T &writeBuffer() { return buffers[writeIndex]; }
+
+    /**
+     * @brief Make the content of writeBuffer() the newest value for the reader
+     */
+    ICACHE_RAM_ATTR void publish()
+    {
+        writeIndex = middle.exchange(writeIndex | FRESH_BIT, std::memory_order_acq_rel) & INDEX_MASK;
+    }
+
+    /**
+     * @brief Take over the newest published value, if there is one
+     * @return the newest value, it stays valid and unchanged until the next read()
+     */
+    ICACHE_RAM_ATTR const T &read()
+    {
+        if (middle.load(std::memory_order_relaxed) & FRESH_BIT)
+        {
+            readIndex = middle.exchange(readIndex, std::memory_order_acq_rel) & INDEX_MASK;
+        }
+        return buffers[readIndex];
+    }
+
+    /**
+     * @return true if a value was published since the last read()
+     */
+    bool hasNewValue() const { return middle.load(std::memory_order_relaxed) & FRESH_BIT; }
+
+private:
+    static constexpr uint8_t INDEX_MASK = 0x03;
+    static constexpr uint8_t FRESH_BIT = 0x04;
+
+    T buffers[3] = {};
+    uint8_t writeIndex = 0;          // only used by the writer
+    uint8_t readIndex = 1;           // only used by the reader
+    std::atomic<uint8_t> middle {2}; // index of the buffer in between, plus FRESH_BIT once published
+};
@@ -25,18 +25,29 @@
 */
 
 #include <esp_now.h>
+#include <esp_wifi.h>
 #include <WiFi.h>
+#include <Preferences.h>
 #include "common.h"
+#include "CRSF.h"
 #include "CRSFHandset.h"
 #include "UnusedPeriph.h"
 #include "hwTimer.h"
+#include "OTA.h"
+#include "lua.h"
+#include "LQCALC.h"
+#include "SPSCFIFO.h"
+#include "PhyRate.h"
+#include "ChannelSurvey.h"
+#include "ModelTable.h"
 
 /***** TODO! Adjust the values in this section to YOUR setup! *****/
 
 // Model receiver's MAC address(es) - replace with YOUR CyberBrick receiver Core MAC address(es)!
 // The example below lists 3 models. If you wish to control only one model, remove the bottom two lines (models 1 and 2).
-// You can control/add up to 20 models to the list below (limitation of ESP32 ESP-NOW peer address table).
-uint8_t cyberbrickRxMAC[][6] =
+// You can add up to 64 models to the list below (EdgeTX receiver numbers 0-63). Receivers can also be bound from
+// EdgeTX without changing this list, a bound receiver replaces the MAC address listed here for its model.
+const uint8_t cyberbrickRxMAC[][6] =
   {
     {0xa1, 0xb1, 0xc1, 0xd1, 0xe1, 0xf1}, // Model 0 receiver MAC address
     {0xa2, 0xb2, 0xc2, 0xd2, 0xe2, 0xf2}, // Model 1 receiver MAC address
@@ -45,12 +56,48 @@ uint8_t cyberbrickRxMAC[][6] =
 // You can pick a model to control in EdgeTX under:
 // MODEL -> Internal RF or External RF -> Receiver <number>
 // where the number matches the model number in the above list.
+// To bind a receiver to the model selected in EdgeTX, press [Bind] there and then hold the
+// button of the CyberBrick Core until the transmitter has picked up its MAC address.
 
 // All models must be programmed to use the same WiFi channel:
 
 #define WIFI_CHANNEL 1 // Change to a channel your model's CyberBrick Core MicroPython code is configured to!
                        // Valid range is from 1 to 11
 
+// Set to 1 to listen on WiFi channels 1-11 at power up and move to the least busy one, if it is clearly
+// quieter than WIFI_CHANNEL. The receivers always start on WIFI_CHANNEL and are moved over with a
+// handshake, which requires receiver scripts supporting the OTA channel switch frame.
+#define WIFI_CHANNEL_SURVEY 0
+
+// Set to 1 to send only the channels which changed since the last full keyframe, which is sent
+// every OTA_KEYFRAME_INTERVAL frames. Saves airtime when several transmitters share a WiFi channel.
+#define OTA_DELTA_FRAMES 0
+
+// Set to 1 to repeat the channels of the previous OTA_HISTORY_DEPTH frames in every frame, so that
+// a receiver can rebuild a lost frame from the next one. Can not be combined with OTA_DELTA_FRAMES.
+#define OTA_HISTORY_FRAMES 0
+
+// Set to 1 to drive several models at once from a single EdgeTX model. Every model listed in
+// multiModelSlices receives its own slice of the handset channels as its CH1, CH2 and so on.
+// The receiver number selected in EdgeTX is ignored in this mode. The frames to the models
+// are spread evenly over the packet interval, so that they do not collide on air.
+#define MULTI_MODEL_SLICES 0
+
+// Set to 1 to send the channels as soon as a complete set has been received from the handset, instead
+// of with the next tick of the RF timer. The timer then only steps in when the handset frames stop.
+// In multi-model mode, the frames to all models are sent right after each other.
+#define RF_SEND_ON_HANDSET_FRAME 0
+
+#if MULTI_MODEL_SLICES
+// {model number in the cyberbrickRxMAC list, first EdgeTX channel, number of channels (multiple of 8)}
+static const multiModelSlice_t multiModelSlices[] =
+  {
+    {0,  1, 8}, // Model 0 gets CH1-8
+    {1,  9, 8}, // Model 1 gets CH9-16
+    {2, 17, 8}  // Model 2 gets CH17-24, requires 32 channels to be enabled in EdgeTX
+  };
+#endif
+
 /******************************************************************/
 
 // The following is replied in a CRSF ping response telegram to the handset and
@@ -59,38 +106,205 @@ uint8_t cyberbrickRxMAC[][6] =
 const char device_name[] = "CyberBrick TX"; // max. 16 characters
 char versionID[] = "1.0.0";
 
-// Current state of channels, CRSF format
-volatile uint16_t ChannelData[CRSF_NUM_CHANNELS];
+// Packet rates selectable per model in EdgeTX under SYS -> Tools -> ExpressLRS (or CRSF device) -> Packet Rate
+static const uint32_t RFpacketIntervalsUS[] = {20000, 10000, 6667, 4000, 2000}; // 50, 100, 150, 250 and 500 Hz
+static struct luaItem_selection luaPacketRate = {
+    {"Packet Rate", CRSF_TEXT_SELECTION},
+    0, // value
+    "50Hz;100Hz;150Hz;250Hz;500Hz",
+    ""
+};
+
+// PHY rate of the ESP-NOW frames, selectable per model. Auto adapts the rate to the link, between
+// 1 Mbps 802.11b and 24 Mbps 802.11g. The options after Auto are the phyProfile_e profiles in order.
+static struct luaItem_selection luaPhyRate = {
+    {"PHY Rate", CRSF_TEXT_SELECTION},
+    0, // value
+    "Auto;1M 11b;2M 11b;11M 11b;6M 11g;12M 11g;24M 11g;54M 11g;MCS0 11n;MCS3 11n;MCS7 11n;LR 500k;LR 250k",
+    ""
+};
+// What the receivers do when the channels from the handset stop, selectable per model.
+// The options are the ota_failsafe_mode_e modes in order.
+static struct luaItem_selection luaFailsafe = {
+    {"Failsafe", CRSF_TEXT_SELECTION},
+    OTA_FAILSAFE_CUT, // value
+    "Hold;Neutral;Cut",
+    ""
+};
+// Estimated share of the time the WiFi channel is occupied by our frames, updated with the link statistics
+static char airtimeText[8] = "-";
+static struct luaItem_string luaAirtime = {
+    {"Airtime", CRSF_INFO},
+    airtimeText
+};
+
+// Current state of channels, CRSF format. Only used by the handset parser, which publishes
+// complete sets to ChannelSnapshot for the RF send task.
+uint16_t ChannelData[CRSF_NUM_CHANNELS];
+TripleBuffer<channelSnapshot_t> ChannelSnapshot;
 connectionState_e connectionState = awatingFirstPacket;
 
 CRSFHandset *handset = new CRSFHandset();
-esp_now_peer_info_t peerInfo;
+ModelTable modelTable; // receiver MAC address of every model, as compiled in or bound
+Preferences preferences; // per model settings, stored in NVS
+// Number of frames sent per packet interval, one per model
+#if MULTI_MODEL_SLICES
+#define RF_SLOT_COUNT (sizeof(multiModelSlices)/sizeof(multiModelSlices[0]))
+#else
+#define RF_SLOT_COUNT 1
+#endif
+
+#if OTA_DELTA_FRAMES && OTA_HISTORY_FRAMES
+#error "OTA_DELTA_FRAMES and OTA_HISTORY_FRAMES can not be combined"
+#endif
+
+#if OTA_DELTA_FRAMES
+OtaDeltaEncoder otaEncoder[RF_SLOT_COUNT]; // one per receiver
+#elif OTA_HISTORY_FRAMES
+OtaHistoryEncoder otaEncoder[RF_SLOT_COUNT]; // one per receiver
+#endif
+static uint16_t otaSequence[RF_SLOT_COUNT]; // OTA frame sequence number, counted per receiver
+PhyRateController phyRate[RF_SLOT_COUNT]; // one per receiver
 
-bool SendRCdataToRF();
+#if WIFI_CHANNEL_SURVEY
+static ChannelSwitch channelSwitch;
+static uint8_t wifiChannel = WIFI_CHANNEL;           // channel the transmitter is on, changed by the RF send task
+static channelSurveyResult_t surveyResults[CHANNEL_SURVEY_CHANNELS];
+static volatile uint8_t surveyChannel = 1;
+#endif
+
+// RF send task and its timing statistics, all times in microseconds
+#define RF_NOTIFY_TIMER   (1 << 0) // RF timer tick
+#define RF_NOTIFY_HANDSET (1 << 1) // new channels from the handset, with RF_SEND_ON_HANDSET_FRAME
+#define RF_NOTIFY_FAILSAFE (1 << 2) // the handset UART was lost
+static TaskHandle_t rfSendTaskHandle = nullptr;
+static volatile uint32_t rfTimerTicks = 0;
+static volatile uint32_t rfTimerTickUS = 0;    // time of the last timer interrupt
+static volatile uint32_t rfHandsetFrameUS = 0; // time the last channel set was published by the handset
+static uint32_t rfPacketIntervalUS = RF_FRAME_RATE_US;
+static bool rfFailsafe = false; // failsafe frames are sent instead of the channels, owned by the RF send task
+static volatile ota_failsafe_mode_e failsafeMode = OTA_FAILSAFE_CUT; // of the current model
+typedef struct {
+  uint32_t sends;       // number of frames handed to ESP-NOW
+  uint32_t timerSends;  // of which triggered by the timer, all of them without RF_SEND_ON_HANDSET_FRAME
+  uint32_t missedTicks; // timer ticks which arrived while the previous one was still pending
+  uint32_t lastLatency; // trigger (timer interrupt or handset frame) to esp_now_send() latency
+  uint32_t maxLatency;
+  uint64_t sumLatency;  // average is sumLatency / sends
+  uint32_t lastDataAge; // reception of the channels from the handset to esp_now_send()
+  uint32_t maxDataAge;
+  uint64_t sumDataAge;  // average is sumDataAge / sends
+  uint32_t failsafes;   // handset losses which started the failsafe
+} rfSendStats_t;
+volatile rfSendStats_t rfSendStats = {};
+
+// Link quality per receiver, from the results of the ESP-NOW sends
+typedef struct {
+  LQCALC<LINK_STATS_LQ_WINDOW> lq;
+  uint32_t sentUS;       // micros() right before the last successful esp_now_send()
+  uint32_t sendErrors;   // esp_now_send() failures
+  uint32_t ackFailures;  // frames not acknowledged by the receiver after all MAC retries
+  uint32_t latencySumUS; // esp_now_send() to send callback, since the last LinkStatistics report
+  uint32_t latencyMaxUS; // higher latencies indicate MAC retries on a busy channel
+  uint32_t latencyCount;
+  uint32_t airtimeUS;    // estimated airtime of the frames sent, since the last LinkStatistics report
+  ota_telemetry_t telemetry;  // last telemetry reported by the receiver
+  int8_t downlinkRSSI;        // RSSI of the last telemetry frame from the receiver, in dBm
+  uint32_t telemetryRecvMS;   // millis() when the last telemetry frame was received
+  uint32_t telemetryCount;
+} peerLinkStats_t;
+peerLinkStats_t peerLinkStats[RF_SLOT_COUNT];
+// The link quality and the sums since the last report are updated by the task sending the frames,
+// the ESP-NOW send callback in the WiFi task and loop(), only under this lock
+static portMUX_TYPE peerLinkStatsMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Telemetry frames from the receivers, handed over from the ESP-NOW receive callback to loop()
+typedef struct {
+  uint8_t slot;
+  int8_t rssi;
+  ota_telemetry_t telemetry;
+} telemetryRecord_t;
+// The callback is the only producer and loop() the only consumer, so the FIFO needs no lock
+static SPSCFIFO<128> telemetryFIFO;
+static_assert(sizeof(telemetryRecord_t) <= 128 / 8, "telemetryFIFO to hold at least 8 records");
+
+// Binding, a receiver broadcasting its MAC address is assigned to the current model
+static volatile bool bindingActive = false;
+static volatile bool bindingMACReceived = false;
+static uint8_t bindingMAC[MODEL_MAC_LEN];
+static uint32_t bindingStartMS = 0;
+
+bool SendRCdataToRF(uint8_t slot);
+static void rfSendTask(void *pvParameters);
+static void handsetChannelsPublished();
 void timerCallback();
 bool initESPNOW();
 void ESPNOW_OnDataSentCB(const uint8_t *mac_addr, esp_now_send_status_t status);
+void ESPNOW_OnDataRecvCB(const esp_now_recv_info_t *info, const uint8_t *data, int len);
 static void UARTconnected();
 static void UARTdisconnected();
 void ModelUpdateReq();
+static void SetRFLinkRate(uint8_t index);
+static uint8_t loadModelPacketRate();
+static void luaPacketRateUpdate(struct luaPropertiesCommon *item, uint8_t arg);
+static void SetPhyRate(uint8_t index);
+static uint8_t loadModelPhyRate();
+static void luaPhyRateUpdate(struct luaPropertiesCommon *item, uint8_t arg);
+static uint8_t loadModelFailsafe();
+static void luaFailsafeUpdate(struct luaPropertiesCommon *item, uint8_t arg);
+static bool updateFailsafe();
+static void sendLinkStatistics(uint32_t now);
+static void processTelemetry();
+static void EnterBindingMode();
+static void processBinding(uint32_t now);
+static void newReceiverSelected();
+#if WIFI_CHANNEL_SURVEY
+static uint8_t surveyWiFiChannels();
+static void updateWiFiChannel();
+#endif
 
 // Initialization
 void setup() {
   pinMode(GPIO_PIN_BOOT0, INPUT); // setup so that we can detect pin-change for passthrough mode of the optional ExpressLRS module backpack
   initUnusedDevices();
+  preferences.begin("cyberbrick", false);
+  modelTable.begin(preferences, cyberbrickRxMAC, sizeof(cyberbrickRxMAC)/6);
+  registerLUAParameter(&luaPacketRate, luaPacketRateUpdate);
+  registerLUAParameter(&luaPhyRate, luaPhyRateUpdate);
+  registerLUAParameter(&luaFailsafe, luaFailsafeUpdate);
+  registerLUAParameter(&luaAirtime);
   handset->Begin();
   handset->registerCallbacks(UARTconnected, UARTdisconnected, ModelUpdateReq);
+  handset->registerParameterCallback(luaHandleUpdateParameter, getLUAParameterCount());
+  handset->setBindingCallback(EnterBindingMode);
+#if RF_SEND_ON_HANDSET_FRAME
+  handset->setChannelsPublishedCallback(handsetChannelsPublished);
+  handset->disableMixerSync(); // the frames follow the mixer, there is no phase to correct
+#endif
 
   while (!initESPNOW()) {}
+#if WIFI_CHANNEL_SURVEY
+  channelSwitch.begin(WIFI_CHANNEL, surveyWiFiChannels(), RF_SLOT_COUNT, millis());
+#endif
+  xTaskCreatePinnedToCore(rfSendTask, "rfSend", RF_SEND_TASK_STACK_SIZE, nullptr, RF_SEND_TASK_PRIORITY, &rfSendTaskHandle, RF_SEND_TASK_CORE);
   hwTimer::init(timerCallback);
-  hwTimer::updateIntervalUS(RF_FRAME_RATE_US);
+  luaPacketRate.value = loadModelPacketRate();
+  SetRFLinkRate(luaPacketRate.value);
+  luaPhyRate.value = loadModelPhyRate();
+  SetPhyRate(luaPhyRate.value);
+  luaFailsafe.value = loadModelFailsafe();
+  failsafeMode = (ota_failsafe_mode_e)luaFailsafe.value;
   setConnectionState(awatingFirstPacket);
 }
 
 // Main execution loop
 void loop() {
   handset->handleInput();
-  delay(1); // yield
+  processTelemetry();
+  processBinding(millis());
+  sendLinkStatistics(millis());
+  // Sleep until the next bytes from the handset arrive, the timeout keeps the rest of loop() going
+  handset->waitForInput(HANDSET_INPUT_MAX_WAIT_MS);
 }
 
 bool initESPNOW()
@@ -101,6 +315,8 @@ bool initESPNOW()
   while (!WiFi.STA.started()) {
     delay(100);
   }
+  // Allow the Long Range PHY profiles in addition to the standard 802.11b/g/n rates
+  esp_wifi_set_protocol(WIFI_IF_STA, WIFI_PROTOCOL_11B | WIFI_PROTOCOL_11G | WIFI_PROTOCOL_11N | WIFI_PROTOCOL_LR);
 
   // Init ESP-NOW
   if (esp_now_init() != ESP_OK) return false;
@@ -108,63 +324,560 @@ bool initESPNOW()
   // Register callback to get the status of the transmitted ESP-NOW packet
   if (esp_now_register_send_cb(ESPNOW_OnDataSentCB) != ESP_OK) return false;
 
-  // Register peers
-  bool bResult = true;
-  for (int i = 0; i < sizeof(cyberbrickRxMAC)/6; i++)
-  { 
-    // Iterate through the peer addresses
-    memset(&peerInfo, 0, sizeof(esp_now_peer_info_t));
-    peerInfo.channel = WIFI_CHANNEL;
-    peerInfo.encrypt = false;
-    memcpy(peerInfo.peer_addr, cyberbrickRxMAC[i], 6);
-    if (esp_now_add_peer(&peerInfo) != ESP_OK)
-    {
-      bResult = false;
-    }
-  }
-  return bResult;
+  // Register callback to get the telemetry sent back by the receivers and their bind broadcasts
+  if (esp_now_register_recv_cb(ESPNOW_OnDataRecvCB) != ESP_OK) return false;
+
+  // The receivers are registered as peers on first use, see ModelTable::acquirePeer()
+  return true;
 }
 
 /*
- * Called from timer ISR when there is a CRSF connection from the handset
+ * Called from timer ISR when there is a CRSF connection from the handset.
+ * Only wakes up the RF send task, esp_now_send() must not be called from an ISR.
  */
 void ICACHE_RAM_ATTR timerCallback()
 {
-  // Do not transmit until in disconnected/connected state
-  if (connectionState == awaitingModelId)
-    return;
+  rfTimerTickUS = micros();
+  rfTimerTicks++;
+  BaseType_t higherPriorityTaskWoken = pdFALSE;
+  xTaskNotifyFromISR(rfSendTaskHandle, RF_NOTIFY_TIMER, eSetBits, &higherPriorityTaskWoken);
+  portYIELD_FROM_ISR(higherPriorityTaskWoken);
+}
 
-  SendRCdataToRF();
+/*
+ * Called from loop() when a complete channel set has been received from the handset,
+ * with RF_SEND_ON_HANDSET_FRAME
+ */
+static void handsetChannelsPublished()
+{
+  rfHandsetFrameUS = micros();
+  xTaskNotify(rfSendTaskHandle, RF_NOTIFY_HANDSET, eSetBits);
 }
 
-bool ICACHE_RAM_ATTR SendRCdataToRF()
+static void SendAndCount(uint8_t slot, uint32_t triggerUS)
 {
-  // Send message via ESP-NOW
+  uint32_t latency = micros() - triggerUS;
+  SendRCdataToRF(slot);
+
+  rfSendStats.sends++;
+  rfSendStats.lastLatency = latency;
+  rfSendStats.sumLatency += latency;
+  if (latency > rfSendStats.maxLatency)
+    rfSendStats.maxLatency = latency;
+}
+
+static void rfSendTask(void *pvParameters)
+{
+  uint8_t nextSlot = 0;
+  uint32_t lastTicks = 0;
+  uint32_t lastHandsetSendUS = 0;
+  uint8_t failsafeBurst = 0;
+  for (;;)
+  {
+    // In failsafe, the task also wakes up on its own, as the RF timer is stopped once the UART is lost
+    TickType_t timeout = portMAX_DELAY;
+    if (failsafeBurst > 0)
+      timeout = pdMS_TO_TICKS(FAILSAFE_BURST_INTERVAL_MS);
+    else if (rfFailsafe)
+      timeout = pdMS_TO_TICKS(FAILSAFE_KEEPALIVE_MS);
+    uint32_t events = 0;
+    xTaskNotifyWait(0, UINT32_MAX, &events, timeout);
+
+    // Do not transmit until in disconnected/connected state
+    bool sending = connectionState != awaitingModelId;
+#if WIFI_CHANNEL_SURVEY
+    updateWiFiChannel();
+#endif
+
+    if (updateFailsafe())
+      failsafeBurst = FAILSAFE_BURST_FRAMES;
+    if (rfFailsafe && (failsafeBurst > 0 || events == 0))
+    {
+      // Failsafe frames to every receiver, right away, as a burst and then as keepalive
+      if (failsafeBurst > 0)
+        failsafeBurst--;
+      if (sending)
+      {
+        for (uint8_t slot = 0; slot < RF_SLOT_COUNT; slot++)
+          SendAndCount(slot, micros());
+      }
+    }
+
+    uint32_t ticks = rfTimerTicks - lastTicks;
+    if ((events & RF_NOTIFY_TIMER) && ticks > 0)
+    {
+      lastTicks += ticks;
+      rfSendStats.missedTicks += ticks - 1;
+
+      // Stay in step with the timer, even if ticks were missed
+      uint8_t slot = (nextSlot + ticks - 1) % RF_SLOT_COUNT;
+      nextSlot = (slot + 1) % RF_SLOT_COUNT;
+
+      // With sends triggered by the handset, the timer is only a backstop for when the handset frames stop
+      if (sending && (!RF_SEND_ON_HANDSET_FRAME || micros() - lastHandsetSendUS >= rfPacketIntervalUS))
+      {
+        SendAndCount(slot, rfTimerTickUS);
+        rfSendStats.timerSends++;
+      }
+    }
+
+    if ((events & RF_NOTIFY_HANDSET) && sending)
+    {
+      lastHandsetSendUS = micros();
+      for (uint8_t slot = 0; slot < RF_SLOT_COUNT; slot++)
+        SendAndCount(slot, rfHandsetFrameUS);
+    }
+  }
+}
+
+bool SendRCdataToRF(uint8_t slot)
+{
+  // Newest complete channel set, channels 17-32 are only included when the handset provides them
+  const channelSnapshot_t &channels = ChannelSnapshot.read();
+#if MULTI_MODEL_SLICES
+  uint8_t modelid = multiModelSlices[slot].model;
+  uint8_t firstChannel = multiModelSlices[slot].firstChannel - 1;
+  uint8_t channelCount = multiModelSlices[slot].count;
+  if (firstChannel + channelCount > channels.count)
+    return false; // Slice is not provided by the handset
+#else
   uint8_t modelid = handset->getModelID();
+  uint8_t firstChannel = 0;
+  uint8_t channelCount = channels.count;
+#endif
+
+#if WIFI_CHANNEL_SURVEY
+  if (channelSwitch.hasSwitched(slot))
+    return false; // The receiver waits on the new channel for the transmitter to follow
+#endif
+
+  // Send message via ESP-NOW
   bool bResult = false;
-  if (modelid <= sizeof(cyberbrickRxMAC)/6) // Plausibility check that we are not accessing cyberbrickRxMAC array out of bounds
+  bool peerAdded;
+  const uint8_t *mac = modelTable.acquirePeer(modelid, peerAdded);
+  if (mac != nullptr) // Only models with a known receiver
   {
-    esp_err_t result = esp_now_send(cyberbrickRxMAC[modelid], (uint8_t *) &ChannelData, sizeof(ChannelData));
+    uint8_t frame[OTA_MAX_FRAME_LEN];
+    uint8_t frameLen;
+    if (rfFailsafe)
+      frameLen = OtaBuildFailsafeFrame(frame, failsafeMode);
+#if WIFI_CHANNEL_SURVEY
+    else if (channelSwitch.isAnnouncingTo(slot))
+      frameLen = OtaBuildChannelSwitchFrame(frame, channelSwitch.getTargetChannel());
+#endif
+    else
+#if OTA_DELTA_FRAMES || OTA_HISTORY_FRAMES
+    frameLen = otaEncoder[slot].build(frame, &channels.ch[firstChannel], channelCount);
+#else
+    frameLen = OtaBuildChannelsFrame(frame, &channels.ch[firstChannel], channelCount);
+#endif
+    ota_frame_info_t info;
+    info.sequence = otaSequence[slot]++;
+    info.txTimeUS = micros();
+    uint32_t dataAge = info.txTimeUS - channels.recvUS;
+    info.dataAgeUS = min(dataAge, (uint32_t)OTA_DATA_AGE_MAX);
+    OtaSetFrameInfo(frame, info);
+
+    if (!rfFailsafe)
+    {
+      rfSendStats.lastDataAge = dataAge;
+      rfSendStats.sumDataAge += dataAge;
+      if (dataAge > rfSendStats.maxDataAge)
+        rfSendStats.maxDataAge = dataAge;
+    }
+
+    // A new PHY profile is applied here and not in the send callback, which runs in the WiFi task.
+    // A newly registered peer starts with the default rate.
+    phyProfile_e profile;
+    if (phyRate[slot].takeChange(profile) || peerAdded)
+    {
+      esp_now_rate_config_t rateConfig = PhyRateConfig(phyRate[slot].getProfile());
+      esp_now_set_peer_rate_config(mac, &rateConfig);
+    }
+    // The send callback can run before esp_now_send() returns, so the send time is stored first and
+    // taken back if the frame was not queued
+    const uint32_t sendUS = micros();
+    portENTER_CRITICAL(&peerLinkStatsMux);
+    const uint32_t lastSentUS = peerLinkStats[slot].sentUS;
+    peerLinkStats[slot].sentUS = sendUS;
+    portEXIT_CRITICAL(&peerLinkStatsMux);
+    esp_err_t result = esp_now_send(mac, frame, frameLen);
    
     if (result == ESP_OK) {
       bResult = true;
+      // The EdgeTX sync refers to the first frame of each packet interval, at the time it went to the
+      // radio. The send callback comes after a varying airtime and retries.
+      if (slot == 0 && !rfFailsafe)
+        handset->JustSentRFpacket(sendUS);
+      const uint32_t airtimeUS = PhyAirtimeUS(phyRate[slot].getProfile(), frameLen);
+      portENTER_CRITICAL(&peerLinkStatsMux);
+      peerLinkStats[slot].airtimeUS += airtimeUS;
+      portEXIT_CRITICAL(&peerLinkStatsMux);
+    }
+    else {
+      portENTER_CRITICAL(&peerLinkStatsMux);
+      peerLinkStats[slot].sentUS = lastSentUS;
+      peerLinkStats[slot].sendErrors++;
+      peerLinkStats[slot].lq.add(false);
+      portEXIT_CRITICAL(&peerLinkStatsMux);
+#if OTA_DELTA_FRAMES
+      otaEncoder[slot].requestKeyframe();
+#endif
     }
   }
   return bResult;
 }
 
+#if MULTI_MODEL_SLICES
+static int8_t getSlotOfPeer(const uint8_t *mac_addr)
+{
+  for (uint8_t slot = 0; slot < RF_SLOT_COUNT; slot++)
+  {
+    uint8_t mac[6];
+    if (modelTable.getMAC(multiModelSlices[slot].model, mac) && memcmp(mac_addr, mac, 6) == 0)
+      return slot;
+  }
+  return -1;
+}
+#else
+static int8_t getSlotOfPeer(const uint8_t *mac_addr)
+{
+  uint8_t mac[6];
+  if (modelTable.getMAC(handset->getModelID(), mac) && memcmp(mac_addr, mac, 6) == 0)
+    return 0;
+  return -1;
+}
+#endif
+
 // ESP-NOW callback, called when data is sent
 void ESPNOW_OnDataSentCB(const uint8_t *mac_addr, esp_now_send_status_t status) {
+  int8_t slot = getSlotOfPeer(mac_addr);
+  if (slot < 0)
+    return;
+
+  peerLinkStats_t &stats = peerLinkStats[slot];
+  const uint32_t now = micros();
+  portENTER_CRITICAL(&peerLinkStatsMux);
+  uint32_t latency = now - stats.sentUS;
+  stats.latencySumUS += latency;
+  stats.latencyCount++;
+  if (latency > stats.latencyMaxUS)
+    stats.latencyMaxUS = latency;
+  stats.lq.add(status == ESP_NOW_SEND_SUCCESS);
+  if (status != ESP_NOW_SEND_SUCCESS)
+    stats.ackFailures++;
+  portEXIT_CRITICAL(&peerLinkStatsMux);
+  phyRate[slot].addResult(status == ESP_NOW_SEND_SUCCESS);
+
   if (status == ESP_NOW_SEND_SUCCESS)
   {
-    handset->JustSentRFpacket();
+#if WIFI_CHANNEL_SURVEY
+    channelSwitch.ackReceived(slot, millis());
+#endif
+  }
+  else
+  {
+#if OTA_DELTA_FRAMES
+    // The receiver may have missed a keyframe, do not leave it waiting for the next regular one
+    otaEncoder[slot].requestKeyframe();
+#endif
+  }
+}
+
+// ESP-NOW callback, called when data is received
+void ESPNOW_OnDataRecvCB(const esp_now_recv_info_t *info, const uint8_t *data, int len)
+{
+  // Receivers in bind mode broadcast their own MAC address, see send_bind() in the receiver scripts
+  if (bindingActive && len == MODEL_MAC_LEN && memcmp(data, info->src_addr, MODEL_MAC_LEN) == 0)
+  {
+    if (!bindingMACReceived)
+    {
+      memcpy(bindingMAC, data, MODEL_MAC_LEN);
+      bindingMACReceived = true;
+    }
+    return;
+  }
+
+  telemetryRecord_t record;
+  int8_t slot = getSlotOfPeer(info->src_addr);
+  if (slot < 0 || len > OTA_MAX_FRAME_LEN || !OtaDecodeTelemetryFrame(data, len, record.telemetry))
+    return;
+
+  record.slot = slot;
+  record.rssi = info->rx_ctrl->rssi;
+  telemetryFIFO.pushBytes((const uint8_t *)&record, sizeof(record)); // dropped if loop() lags behind
+}
+
+static void processTelemetry()
+{
+  telemetryRecord_t record;
+  while (telemetryFIFO.popBytes((uint8_t *)&record, sizeof(record)))
+  {
+    peerLinkStats_t &stats = peerLinkStats[record.slot];
+    stats.telemetry = record.telemetry;
+    stats.downlinkRSSI = record.rssi;
+    stats.telemetryRecvMS = millis();
+    stats.telemetryCount++;
+  }
+}
+
+/*
+ * Report the link quality to the handset, shown in EdgeTX as the RQly telemetry sensor,
+ * together with the RSSI and battery voltage reported by the receiver
+ */
+static void sendLinkStatistics(uint32_t now)
+{
+  static uint32_t lastSentMS = 0;
+  const uint32_t intervalMS = now - lastSentMS;
+  if (intervalMS < LINK_STATS_INTERVAL_MS || connectionState != connected)
+    return;
+  lastSentMS = now;
+
+  // Report the worst receiver, so that the EdgeTX RQly alarm warns before any of the models fails
+  uint8_t worst = 0;
+  uint8_t lq = 100;
+  uint32_t airtimeUS = 0;
+  portENTER_CRITICAL(&peerLinkStatsMux);
+  for (uint8_t slot = 0; slot < RF_SLOT_COUNT; slot++)
+  {
+    const uint8_t slotLQ = peerLinkStats[slot].lq.getLQ();
+    if (slot == 0 || slotLQ < lq)
+    {
+      worst = slot;
+      lq = slotLQ;
+    }
+    airtimeUS += peerLinkStats[slot].airtimeUS;
+    peerLinkStats[slot].airtimeUS = 0;
+    peerLinkStats[slot].latencySumUS = 0;
+    peerLinkStats[slot].latencyMaxUS = 0;
+    peerLinkStats[slot].latencyCount = 0;
+  }
+  portEXIT_CRITICAL(&peerLinkStatsMux);
+  // Channel time used by the frames to all receivers, without MAC retries, in 0.1 %
+  const uint32_t airtimePermille = min(airtimeUS / intervalMS, (uint32_t)1000);
+  snprintf(airtimeText, sizeof(airtimeText), "%u.%u%%", (unsigned)(airtimePermille / 10), (unsigned)(airtimePermille % 10));
+  const peerLinkStats_t &stats = peerLinkStats[worst];
+  const bool telemetryValid = stats.telemetryCount > 0 && now - stats.telemetryRecvMS < TELEMETRY_TIMEOUT_MS;
+
+  // The acknowledgement of the receiver confirms both directions
+  CRSF::LinkStatistics.uplink_Link_quality = lq;
+  CRSF::LinkStatistics.downlink_Link_quality = lq;
+  CRSF::LinkStatistics.uplink_RSSI_1 = telemetryValid ? -stats.telemetry.rssiDBM : 0;
+  CRSF::LinkStatistics.downlink_RSSI_1 = telemetryValid ? -stats.downlinkRSSI : 0;
+  CRSF::LinkStatistics.rf_Mode = luaPacketRate.value;
+  CRSF::LinkStatistics.uplink_TX_Power = 3; // CRSF power index for 100 mW, WiFi.setTxPower(WIFI_POWER_19_5dBm)
+
+  // 14 bytes, fits into the smallest handset time-slot, see CRSFHandset::adjustMaxPacketSize()
+  uint8_t *linkStatisticsFrame = handset->reserveTelemetry(CRSF_LINK_STATISTICS_FRAME_LEN, HANDSET_OUT_LINK_STATS);
+  if (linkStatisticsFrame != nullptr)
+  {
+    CRSFHandset::makeLinkStatisticsPacket(linkStatisticsFrame);
+    handset->commitTelemetry();
+  }
+
+  // The battery voltage of the current model, or in multi-model mode the lowest one reported
+  uint16_t batteryMV = 0;
+  for (uint8_t slot = 0; slot < RF_SLOT_COUNT; slot++)
+  {
+    const peerLinkStats_t &peer = peerLinkStats[slot];
+    if (peer.telemetryCount > 0 && now - peer.telemetryRecvMS < TELEMETRY_TIMEOUT_MS && peer.telemetry.batteryMV > 0 &&
+        (batteryMV == 0 || peer.telemetry.batteryMV < batteryMV))
+      batteryMV = peer.telemetry.batteryMV;
+  }
+
+  // Only queue the battery voltage if it can go out within the next handset time-slot
+  if (batteryMV > 0 && handset->CanQueueTelemetry(CRSF_BATTERY_FRAME_LEN))
+  {
+    uint8_t *batteryFrame = handset->reserveTelemetry(CRSF_BATTERY_FRAME_LEN);
+    if (batteryFrame != nullptr)
+    {
+      CRSFHandset::makeBatteryPacket(batteryFrame, batteryMV);
+      handset->commitTelemetry();
+    }
+  }
+}
+
+// Called when the bind command is received from the handset
+static void EnterBindingMode()
+{
+  bindingMACReceived = false;
+  bindingStartMS = millis();
+  bindingActive = true;
+}
+
+// Assign the first receiver heard in bind mode to the model currently selected in EdgeTX
+static void processBinding(uint32_t now)
+{
+  if (!bindingActive)
+    return;
+
+  if (bindingMACReceived)
+  {
+    bindingActive = false;
+    modelTable.setMAC(handset->getModelID(), bindingMAC);
+    newReceiverSelected();
+  }
+  else if (now - bindingStartMS >= BIND_TIMEOUT_MS)
+  {
+    bindingActive = false;
+  }
+}
+
+#if WIFI_CHANNEL_SURVEY
+// Promiscuous mode callback, counts the frames of other stations on the surveyed channel
+static void IRAM_ATTR surveyPromiscuousCB(void *buf, wifi_promiscuous_pkt_type_t type)
+{
+  const wifi_promiscuous_pkt_t *pkt = (const wifi_promiscuous_pkt_t *)buf;
+  const wifi_phy_rate_t rate = pkt->rx_ctrl.sig_mode ? (wifi_phy_rate_t)(WIFI_PHY_RATE_MCS0_LGI + pkt->rx_ctrl.mcs)
+                                                     : (wifi_phy_rate_t)pkt->rx_ctrl.rate;
+  channelSurveyResult_t &result = surveyResults[surveyChannel - 1];
+  result.packets++;
+  result.airtimeUS += PhyFrameAirtimeUS(rate, pkt->rx_ctrl.sig_len);
+}
+
+/*
+ * Listen on every channel for CHANNEL_SURVEY_DWELL_MS, then return to WIFI_CHANNEL
+ * Returns the channel to move to, WIFI_CHANNEL if none is clearly quieter
+ */
+static uint8_t surveyWiFiChannels()
+{
+  const wifi_promiscuous_filter_t filter = {WIFI_PROMIS_FILTER_MASK_ALL};
+  esp_wifi_set_promiscuous_filter(&filter);
+  esp_wifi_set_promiscuous_rx_cb(surveyPromiscuousCB);
+  memset(surveyResults, 0, sizeof(surveyResults));
+  for (uint8_t channel = 1; channel <= CHANNEL_SURVEY_CHANNELS; channel++)
+  {
+    surveyChannel = channel;
+    esp_wifi_set_channel(channel, WIFI_SECOND_CHAN_NONE);
+    uint32_t startUS = micros();
+    esp_wifi_set_promiscuous(true);
+    delay(CHANNEL_SURVEY_DWELL_MS);
+    esp_wifi_set_promiscuous(false);
+    surveyResults[channel - 1].dwellUS = micros() - startUS;
+  }
+  esp_wifi_set_channel(WIFI_CHANNEL, WIFI_SECOND_CHAN_NONE);
+  return ChannelSurveySelect(surveyResults, WIFI_CHANNEL);
+}
+
+// Called by the RF send task, which owns the WiFi channel once the survey is done
+static void updateWiFiChannel()
+{
+  channelSwitch.update(millis());
+  if (channelSwitch.getChannel() != wifiChannel)
+  {
+    wifiChannel = channelSwitch.getChannel();
+    esp_wifi_set_channel(wifiChannel, WIFI_SECOND_CHAN_NONE);
   }
 }
+#endif
+
+static void SetRFLinkRate(uint8_t index)
+{
+  // The baud rate of the handset UART limits how often the handset can send RC packets
+  uint32_t intervalUS = max(RFpacketIntervalsUS[index], (uint32_t)handset->getMinPacketInterval());
+  handset->setPacketInterval(intervalUS);
+  rfPacketIntervalUS = intervalUS;
+  hwTimer::updateIntervalUS(intervalUS / RF_SLOT_COUNT);
+}
+
+static uint8_t loadModelPacketRate()
+{
+  char key[12];
+  snprintf(key, sizeof(key), "rate%u", handset->getModelID());
+  uint8_t index = preferences.getUChar(key, 0);
+  return (index < sizeof(RFpacketIntervalsUS)/sizeof(RFpacketIntervalsUS[0])) ? index : 0;
+}
+
+static void luaPacketRateUpdate(struct luaPropertiesCommon *item, uint8_t arg)
+{
+  if (arg >= sizeof(RFpacketIntervalsUS)/sizeof(RFpacketIntervalsUS[0]))
+  {
+    luaPacketRate.value = loadModelPacketRate();
+    return;
+  }
+
+  char key[12];
+  snprintf(key, sizeof(key), "rate%u", handset->getModelID());
+  preferences.putUChar(key, arg);
+  SetRFLinkRate(arg);
+}
+
+static void SetPhyRate(uint8_t index)
+{
+  // Index 0 is Auto, the others select a fixed profile
+  for (uint8_t slot = 0; slot < RF_SLOT_COUNT; slot++)
+    phyRate[slot].setProfile(index == 0 ? PHY_1M_11B : (phyProfile_e)(index - 1), index == 0);
+}
+
+static uint8_t loadModelPhyRate()
+{
+  char key[12];
+  snprintf(key, sizeof(key), "phy%u", handset->getModelID());
+  uint8_t index = preferences.getUChar(key, 0);
+  return (index <= PHY_PROFILE_COUNT) ? index : 0;
+}
+
+static void luaPhyRateUpdate(struct luaPropertiesCommon *item, uint8_t arg)
+{
+  if (arg > PHY_PROFILE_COUNT)
+  {
+    luaPhyRate.value = loadModelPhyRate();
+    return;
+  }
+
+  char key[12];
+  snprintf(key, sizeof(key), "phy%u", handset->getModelID());
+  preferences.putUChar(key, arg);
+  SetPhyRate(arg);
+}
+
+static uint8_t loadModelFailsafe()
+{
+  char key[12];
+  snprintf(key, sizeof(key), "fs%u", handset->getModelID());
+  uint8_t mode = preferences.getUChar(key, OTA_FAILSAFE_CUT);
+  return (mode < OTA_FAILSAFE_MODE_COUNT) ? mode : OTA_FAILSAFE_CUT;
+}
+
+static void luaFailsafeUpdate(struct luaPropertiesCommon *item, uint8_t arg)
+{
+  if (arg >= OTA_FAILSAFE_MODE_COUNT)
+  {
+    luaFailsafe.value = loadModelFailsafe();
+    return;
+  }
+
+  char key[12];
+  snprintf(key, sizeof(key), "fs%u", handset->getModelID());
+  preferences.putUChar(key, arg);
+  failsafeMode = (ota_failsafe_mode_e)arg;
+}
+
+/*
+ * Called by the RF send task before every send. The handset is lost when its UART is, or already
+ * when its channels are overdue by a few packet intervals, which is checked with every RF timer tick.
+ * Returns true when the failsafe just started.
+ */
+static bool updateFailsafe()
+{
+  const uint32_t deadlineUS = max(FAILSAFE_DETECT_INTERVALS * rfPacketIntervalUS, (uint32_t)FAILSAFE_DETECT_MIN_US);
+  const bool lost = connectionState == disconnected ||
+                    (connectionState == connected && micros() - handset->GetRCdataLastRecv() > deadlineUS);
+  if (lost == rfFailsafe)
+    return false;
+
+  rfFailsafe = lost;
+  if (lost)
+    rfSendStats.failsafes++;
+  return lost;
+}
 
 static void UARTdisconnected()
 {
   hwTimer::stop();
   setConnectionState(disconnected);
+  // Usually the failsafe is already running, as the channels stopped well before the UART watchdog fired
+  xTaskNotify(rfSendTaskHandle, RF_NOTIFY_FAILSAFE, eSetBits);
 }
 
 static void UARTconnected()
@@ -180,6 +893,9 @@ static void UARTconnected()
     setConnectionState(awaitingModelId);
   }
 
+  // The baud rate might have changed, check the packet rate is still supported
+  SetRFLinkRate(luaPacketRate.value);
+
   // Start the timer to get EdgeTX sync going and a ModelID update sent
   hwTimer::resume();
 }
@@ -190,4 +906,49 @@ void ModelUpdateReq()
   {
     setConnectionState(connected);
   }
+
+  newReceiverSelected();
+
+  // Each model keeps its own packet rate
+  uint8_t rateIndex = loadModelPacketRate();
+  if (rateIndex != luaPacketRate.value)
+  {
+    luaPacketRate.value = rateIndex;
+    SetRFLinkRate(rateIndex);
+  }
+  // ... and its own PHY rate, which is then applied to the peer of the new model
+  luaPhyRate.value = loadModelPhyRate();
+  SetPhyRate(luaPhyRate.value);
+  luaFailsafe.value = loadModelFailsafe();
+  failsafeMode = (ota_failsafe_mode_e)luaFailsafe.value;
+}
+
+// Reset the per receiver state after a model change or when a receiver was bound
+static void newReceiverSelected()
+{
+#if !MULTI_MODEL_SLICES
+  // The link quality of the previous model no longer applies
+  portENTER_CRITICAL(&peerLinkStatsMux);
+  peerLinkStats[0].lq.reset();
+  portEXIT_CRITICAL(&peerLinkStatsMux);
+#endif
+#if WIFI_CHANNEL_SURVEY
+  // The new receiver starts on WIFI_CHANNEL
+#if MULTI_MODEL_SLICES
+  uint32_t peers = 0;
+  for (uint8_t slot = 0; slot < RF_SLOT_COUNT; slot++)
+  {
+    if (multiModelSlices[slot].model == handset->getModelID())
+      peers |= 1UL << slot;
+  }
+  channelSwitch.restart(peers);
+#else
+  channelSwitch.restart(1UL);
+#endif
+#endif
+#if OTA_DELTA_FRAMES
+  // A different receiver needs a keyframe before it can decode any delta
+  for (uint8_t slot = 0; slot < RF_SLOT_COUNT; slot++)
+    otaEncoder[slot].requestKeyframe();
+#endif
 }
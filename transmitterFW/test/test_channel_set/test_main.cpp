@@ -0,0 +1,113 @@
+/*
+ * This file belongs to the CyberBrick ESP-NOW transmitter & receiver project, hosted originally at:
+ * https://github.com/rotorman/CyberBrick_ESPNOW
+ * Copyright (C) 2025, Risto Kõiva
+ *
+ * License GPL-3.0: https://www.gnu.org/licenses/gpl-3.0.html
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <unity.h>
+#include "CrsfChannelSet.h"
+
+static CrsfChannelSet *channelSet;
+
+void setUp(void) { channelSet = new CrsfChannelSet(); }
+void tearDown(void) { delete channelSet; }
+
+// One handset period, @return the number of channels published in it, 0 if none, 0xFF if more than one set
+static uint8_t period(bool withUpperHalf)
+{
+    uint8_t published = channelSet->add(false);
+    if (withUpperHalf)
+    {
+        const uint8_t count = channelSet->add(true);
+        if (count != 0)
+            published = published != 0 ? 0xFF : count;
+    }
+    return published;
+}
+
+// The first lower half is published on its own, the upper half is not known to follow yet
+static void startExtended()
+{
+    TEST_ASSERT_EQUAL(16, channelSet->add(false));
+    TEST_ASSERT_EQUAL(32, channelSet->add(true));
+}
+
+void test_16_channels(void)
+{
+    for (int i = 0; i < 10; i++)
+        TEST_ASSERT_EQUAL(16, period(false));
+    TEST_ASSERT_FALSE(channelSet->isExtended());
+}
+
+void test_32_channels(void)
+{
+    startExtended();
+    for (int i = 0; i < 10; i++)
+        TEST_ASSERT_EQUAL(32, period(true));
+    TEST_ASSERT_TRUE(channelSet->isExtended());
+}
+
+void test_switch_32_to_16_channels(void)
+{
+    startExtended();
+    for (int i = 0; i < 10; i++)
+        TEST_ASSERT_EQUAL(32, period(true));
+
+    // The handset switched to a model with 16 channels, the first lower half still waits for its
+    // upper half, the next one ends the extended mode
+    TEST_ASSERT_EQUAL(0, period(false));
+    for (int i = 0; i < 10; i++)
+        TEST_ASSERT_EQUAL(16, period(false));
+    TEST_ASSERT_FALSE(channelSet->isExtended());
+
+    // And back
+    startExtended();
+    for (int i = 0; i < 10; i++)
+        TEST_ASSERT_EQUAL(32, period(true));
+}
+
+void test_lost_upper_half(void)
+{
+    startExtended();
+    for (int i = 0; i < 10; i++)
+        TEST_ASSERT_EQUAL(32, period(true));
+
+    // A single upper half lost on the UART, the next lower half is sent as a set of 16 channels
+    // and the extended mode starts over with its upper half
+    TEST_ASSERT_EQUAL(0, period(false));
+    startExtended();
+    for (int i = 0; i < 10; i++)
+        TEST_ASSERT_EQUAL(32, period(true));
+    TEST_ASSERT_TRUE(channelSet->isExtended());
+}
+
+void test_reset(void)
+{
+    startExtended();
+    channelSet->reset();
+    TEST_ASSERT_FALSE(channelSet->isExtended());
+    TEST_ASSERT_EQUAL(16, period(false));
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_16_channels);
+    RUN_TEST(test_32_channels);
+    RUN_TEST(test_switch_32_to_16_channels);
+    RUN_TEST(test_lost_upper_half);
+    RUN_TEST(test_reset);
+    return UNITY_END();
+}
@@ -0,0 +1,145 @@
+/*
+ * This file belongs to the CyberBrick ESP-NOW transmitter & receiver project, hosted originally at:
+ * https://github.com/rotorman/CyberBrick_ESPNOW
+ * Copyright (C) 2025, Risto Kõiva
+ *
+ * License GPL-3.0: https://www.gnu.org/licenses/gpl-3.0.html
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <unity.h>
+#include "ChannelSurvey.h"
+
+#define HOME 1
+#define TARGET 6
+#define FRAME_MS 20
+
+static ChannelSwitch *channelSwitch;
+static uint32_t nowMS;
+
+void setUp(void)
+{
+    channelSwitch = new ChannelSwitch();
+    nowMS = 1000;
+}
+
+void tearDown(void) { delete channelSwitch; }
+
+// One packet interval, in which the peers in acking acknowledge their frame
+static void step(uint32_t acking)
+{
+    nowMS += FRAME_MS;
+    for (uint8_t peer = 0; peer < 32; peer++)
+    {
+        if (acking & (1UL << peer))
+            channelSwitch->ackReceived(peer, nowMS);
+    }
+    channelSwitch->update(nowMS);
+}
+
+static void run(uint32_t ms, uint32_t acking)
+{
+    for (uint32_t end = nowMS + ms; nowMS < end;)
+        step(acking);
+}
+
+void test_switch_when_all_acknowledge(void)
+{
+    channelSwitch->begin(HOME, TARGET, 2, nowMS);
+    step(0b11);
+    TEST_ASSERT_TRUE(channelSwitch->isAnnouncingTo(0));
+    step(0b11);
+    TEST_ASSERT_EQUAL(TARGET, channelSwitch->getChannel());
+}
+
+void test_receiver_off_does_not_block(void)
+{
+    channelSwitch->begin(HOME, TARGET, 3, nowMS);
+    run(CHANNEL_SWITCH_LISTEN_MS + FRAME_MS, 0b011);
+    TEST_ASSERT_EQUAL(TARGET, channelSwitch->getChannel());
+    run(10000, 0b011);
+    TEST_ASSERT_EQUAL(TARGET, channelSwitch->getChannel());
+}
+
+void test_no_switch_without_receivers(void)
+{
+    channelSwitch->begin(HOME, TARGET, 2, nowMS);
+    run(10000, 0);
+    TEST_ASSERT_EQUAL(HOME, channelSwitch->getChannel());
+    TEST_ASSERT_FALSE(channelSwitch->isAnnouncingTo(0));
+}
+
+void test_silent_receiver_is_given_up(void)
+{
+    channelSwitch->begin(HOME, TARGET, 2, nowMS);
+    run(FRAME_MS * 2, 0b11);
+    TEST_ASSERT_EQUAL(TARGET, channelSwitch->getChannel());
+    run(CHANNEL_SWITCH_LOST_MS * 2, 0b01);
+    TEST_ASSERT_EQUAL(TARGET, channelSwitch->getChannel());
+    run(CHANNEL_SWITCH_LOST_MS + FRAME_MS, 0);
+    TEST_ASSERT_EQUAL(HOME, channelSwitch->getChannel());
+}
+
+void test_new_receiver_does_not_strand_the_others(void)
+{
+    channelSwitch->begin(HOME, TARGET, 2, nowMS);
+    run(FRAME_MS * 2, 0b11);
+    TEST_ASSERT_EQUAL(TARGET, channelSwitch->getChannel());
+
+    // Peer 1 gets a receiver which is off, peer 0 waits on the new channel meanwhile
+    channelSwitch->restart(0b10);
+    step(0);
+    TEST_ASSERT_EQUAL(HOME, channelSwitch->getChannel());
+    TEST_ASSERT_TRUE(channelSwitch->hasSwitched(0));
+    TEST_ASSERT_TRUE(channelSwitch->isAnnouncingTo(1));
+    run(CHANNEL_SWITCH_LISTEN_MS, 0);
+    TEST_ASSERT_EQUAL(TARGET, channelSwitch->getChannel());
+
+    // A receiver which answers is moved along
+    channelSwitch->restart(0b10);
+    step(0);
+    step(0b10);
+    run(CHANNEL_SWITCH_LISTEN_MS, 0b11);
+    TEST_ASSERT_EQUAL(TARGET, channelSwitch->getChannel());
+    run(CHANNEL_SWITCH_LOST_MS * 2, 0b11);
+    TEST_ASSERT_EQUAL(TARGET, channelSwitch->getChannel());
+}
+
+void test_waiting_receiver_returns_after_timeout(void)
+{
+    channelSwitch->begin(HOME, TARGET, 2, nowMS);
+    run(FRAME_MS * 2, 0b11);
+
+    // The new receiver of peer 1 was heard, but does not follow
+    channelSwitch->restart(0b10);
+    step(0b10);
+    const uint32_t startMS = nowMS;
+    while (channelSwitch->getChannel() == HOME && nowMS - startMS < CHANNEL_SWITCH_ANNOUNCE_MS * 2)
+    {
+        nowMS += FRAME_MS;
+        channelSwitch->update(nowMS);
+    }
+    TEST_ASSERT_EQUAL(TARGET, channelSwitch->getChannel());
+    TEST_ASSERT_LESS_OR_EQUAL(CHANNEL_SWITCH_ANNOUNCE_MS, nowMS - startMS);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_switch_when_all_acknowledge);
+    RUN_TEST(test_receiver_off_does_not_block);
+    RUN_TEST(test_no_switch_without_receivers);
+    RUN_TEST(test_silent_receiver_is_given_up);
+    RUN_TEST(test_new_receiver_does_not_strand_the_others);
+    RUN_TEST(test_waiting_receiver_returns_after_timeout);
+    return UNITY_END();
+}
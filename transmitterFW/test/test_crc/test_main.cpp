@@ -0,0 +1,148 @@
+/*
+ * This file belongs to the CyberBrick ESP-NOW transmitter & receiver project, hosted originally at:
+ * https://github.com/rotorman/CyberBrick_ESPNOW
+ * Copyright (C) 2025, Risto Kõiva
+ *
+ * License GPL-3.0: https://www.gnu.org/licenses/gpl-3.0.html
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <unity.h>
+#include <chrono>
+#include <stdio.h>
+#include "crc.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// constexpr, so these do not compile unless the tables are built at compile time
+static constexpr GENERIC_CRC8<0xD5> crc8;
+static constexpr GENERIC_CRC8<0xD5, 4> crc8x4;
+static constexpr Crc2Byte<16, 0x1021> crc16;
+static constexpr Crc2Byte<14, 0x2E57> crc14;
+
+static const uint8_t check[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+
+static uint32_t randomState = 1;
+
+static uint8_t nextRandom()
+{
+    randomState = randomState * 1664525 + 1013904223;
+    return randomState >> 24;
+}
+
+// Bit by bit, MSB first
+static uint16_t referenceCrc(uint8_t bits, uint16_t poly, const uint8_t *data, uint16_t len, uint16_t crc)
+{
+    const uint16_t highbit = 1 << (bits - 1);
+    const uint16_t mask = (uint16_t)((1UL << bits) - 1);
+    while (len--)
+    {
+        crc ^= (uint16_t)*data++ << (bits - 8);
+        for (uint8_t j = 0; j < 8; j++)
+            crc = ((crc << 1) ^ ((crc & highbit) ? poly : 0)) & mask;
+    }
+    return crc;
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_check_values(void)
+{
+    // CRC-8/DVB-S2 as used by CRSF and CRC-16/XMODEM
+    TEST_ASSERT_EQUAL_HEX8(0xBC, crc8.calc(check, sizeof(check)));
+    TEST_ASSERT_EQUAL_HEX8(0xBC, crc8x4.calc(check, sizeof(check)));
+    TEST_ASSERT_EQUAL_HEX16(0x31C3, crc16.calc(check, sizeof(check), 0));
+}
+
+void test_random_buffers(void)
+{
+    uint8_t data[64];
+    for (uint32_t run = 0; run < 20000; run++)
+    {
+        const uint8_t len = nextRandom() % (sizeof(data) + 1);
+        const uint8_t init = nextRandom();
+        for (uint8_t i = 0; i < len; i++)
+            data[i] = nextRandom();
+
+        const uint8_t expected8 = (uint8_t)referenceCrc(8, 0xD5, data, len, init);
+        TEST_ASSERT_EQUAL_HEX8(expected8, crc8.calc(data, len, init));
+        TEST_ASSERT_EQUAL_HEX8(expected8, crc8x4.calc(data, len, init));
+        TEST_ASSERT_EQUAL_HEX16(referenceCrc(16, 0x1021, data, len, init), crc16.calc(data, len, init));
+        TEST_ASSERT_EQUAL_HEX16(referenceCrc(14, 0x2E57, data, len, init), crc14.calc(data, len, init));
+    }
+}
+
+void test_continued_crc(void)
+{
+    // A CRC over two parts, as over a packet wrapping around the end of a ring buffer
+    for (uint8_t split = 0; split <= sizeof(check); split++)
+    {
+        const uint8_t first = crc8x4.calc(check, split);
+        TEST_ASSERT_EQUAL_HEX8(0xBC, crc8x4.calc(&check[split], sizeof(check) - split, first));
+    }
+}
+
+static uint64_t cycleCounter()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0; // no cycle counter, only the time is reported
+#endif
+}
+
+/*
+ * Time per byte of every variant over the lengths of a CRSF RC channels payload and of the largest
+ * OTA frame, run with: pio test -e native -f test_crc -v
+ */
+void test_benchmark(void)
+{
+    const uint32_t ROUNDS = 200000;
+    uint8_t data[64];
+    for (uint8_t &b : data)
+        b = nextRandom();
+    const uint8_t lengths[] = {23, 64};
+    volatile uint16_t sink = 0;
+
+    for (uint8_t len : lengths)
+    {
+        auto time = [&](const char *name, auto &&calc) {
+            const auto start = std::chrono::steady_clock::now();
+            const uint64_t startCycles = cycleCounter();
+            for (uint32_t n = 0; n < ROUNDS; n++)
+            {
+                data[0] = (uint8_t)n; // keeps the compiler from hoisting the CRC out of the loop
+                sink = sink + calc();
+            }
+            const double cycles = (double)(cycleCounter() - startCycles) / ROUNDS / len;
+            const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / ROUNDS / len;
+            printf("%2u bytes %-20s %5.2f ns, %5.2f host cycles per byte\n", len, name, ns, cycles);
+        };
+        time("bit by bit", [&] { return referenceCrc(8, 0xD5, data, len, 0); });
+        time("CRC8", [&] { return crc8.calc(data, len); });
+        time("CRC8 slice-by-4", [&] { return crc8x4.calc(data, len); });
+        time("CRC16", [&] { return crc16.calc(data, len, 0); });
+        time("CRC14", [&] { return crc14.calc(data, len, 0); });
+    }
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_check_values);
+    RUN_TEST(test_random_buffers);
+    RUN_TEST(test_continued_crc);
+    RUN_TEST(test_benchmark);
+    return UNITY_END();
+}
@@ -0,0 +1,251 @@
+/*
+ * This file belongs to the CyberBrick ESP-NOW transmitter & receiver project, hosted originally at:
+ * https://github.com/rotorman/CyberBrick_ESPNOW
+ * Copyright (C) 2025, Risto Kõiva
+ *
+ * License GPL-3.0: https://www.gnu.org/licenses/gpl-3.0.html
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <unity.h>
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include "CrsfRxRing.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+static constexpr GENERIC_CRC8<CRSF_CRC_POLY, 4> crc;
+static CrsfRxRing *ring;
+
+void setUp(void) { ring = new CrsfRxRing(); }
+void tearDown(void) { delete ring; }
+
+// A packet of type 0x16 (RC channels) with payloadLen bytes of payload, all set to fill
+static uint8_t buildPacket(uint8_t *packet, uint8_t payloadLen, uint8_t fill)
+{
+    packet[0] = CRSF_SYNC_BYTE;
+    packet[1] = payloadLen + 2;
+    packet[2] = CRSF_FRAMETYPE_RC_CHANNELS_PACKED;
+    memset(&packet[3], fill, payloadLen);
+    packet[3 + payloadLen] = crc.calc(&packet[2], payloadLen + 1);
+    return payloadLen + 4;
+}
+
+// Write as the UART read does, in up to two parts around the end of the ring
+static uint16_t write(const uint8_t *data, uint16_t len)
+{
+    uint16_t total = 0;
+    while (total < len)
+    {
+        uint16_t space;
+        uint8_t *buffer = ring->writeBuffer(space);
+        if (space == 0)
+            break;
+        const uint16_t chunk = space < len - total ? space : len - total;
+        memcpy(buffer, &data[total], chunk);
+        ring->written(chunk);
+        total += chunk;
+    }
+    return total;
+}
+
+void test_packets_split_over_writes(void)
+{
+    uint8_t stream[600];
+    uint16_t streamLen = 0;
+    uint8_t lengths[40];
+    uint8_t count = 0;
+    while (count < sizeof(lengths))
+    {
+        lengths[count] = 1 + (count * 7) % 58;
+        if (streamLen + lengths[count] + 4U > sizeof(stream))
+            break;
+        streamLen += buildPacket(&stream[streamLen], lengths[count], count);
+        count++;
+    }
+
+    // Every write size, so that the packets are split and wrap around the end of the ring at every point
+    for (uint16_t chunk = 1; chunk <= 64; chunk++)
+    {
+        uint8_t parsed = 0;
+        for (uint16_t pos = 0; pos < streamLen;)
+        {
+            pos += write(&stream[pos], (streamLen - pos) < chunk ? streamLen - pos : chunk);
+            const uint8_t *packet;
+            uint8_t len;
+            crsfRxResult_e result;
+            while ((result = ring->next(crc, packet, len)) != CRSF_RX_INCOMPLETE)
+            {
+                TEST_ASSERT_EQUAL(CRSF_RX_PACKET, result);
+                TEST_ASSERT_EQUAL(lengths[parsed] + 4, len);
+                TEST_ASSERT_EQUAL_HEX8(CRSF_SYNC_BYTE, packet[0]);
+                TEST_ASSERT_EQUAL(parsed, packet[3]);
+                TEST_ASSERT_EQUAL(parsed, packet[len - 2]);
+                parsed++;
+            }
+        }
+        TEST_ASSERT_EQUAL(count, parsed);
+        TEST_ASSERT_EQUAL(0, ring->size());
+    }
+}
+
+void test_garbage_is_skipped(void)
+{
+    uint8_t packet[64];
+    const uint8_t garbage[] = {0x00, 0x12, 0x34, 0x56, 0x78, 0x9A, 0xBC};
+    const uint8_t len = buildPacket(packet, 22, 0x55);
+    write(garbage, sizeof(garbage));
+    write(packet, len);
+
+    const uint8_t *parsed;
+    uint8_t parsedLen;
+    TEST_ASSERT_EQUAL(CRSF_RX_PACKET, ring->next(crc, parsed, parsedLen));
+    TEST_ASSERT_EQUAL(len, parsedLen);
+    TEST_ASSERT_EQUAL_MEMORY(packet, parsed, len);
+    TEST_ASSERT_EQUAL(CRSF_RX_INCOMPLETE, ring->next(crc, parsed, parsedLen));
+}
+
+void test_bad_length_and_crc(void)
+{
+    uint8_t packet[64];
+    const uint8_t *parsed;
+    uint8_t parsedLen;
+
+    // A sync byte followed by an impossible length, then a packet with a broken CRC, then a good one
+    const uint8_t badLength[] = {CRSF_SYNC_BYTE, 0xFF};
+    write(badLength, sizeof(badLength));
+    uint8_t len = buildPacket(packet, 10, 0x11);
+    packet[len - 1] ^= 0x01;
+    write(packet, len);
+    len = buildPacket(packet, 10, 0x22);
+    write(packet, len);
+
+    TEST_ASSERT_EQUAL(CRSF_RX_SKIPPED, ring->next(crc, parsed, parsedLen));
+    TEST_ASSERT_EQUAL(CRSF_RX_BAD_CRC, ring->next(crc, parsed, parsedLen));
+    TEST_ASSERT_EQUAL(CRSF_RX_PACKET, ring->next(crc, parsed, parsedLen));
+    TEST_ASSERT_EQUAL_MEMORY(packet, parsed, len);
+}
+
+void test_incomplete_packet_waits(void)
+{
+    uint8_t packet[64];
+    const uint8_t *parsed;
+    uint8_t parsedLen;
+    const uint8_t len = buildPacket(packet, 22, 0x33);
+    write(packet, len - 1);
+    TEST_ASSERT_EQUAL(CRSF_RX_INCOMPLETE, ring->next(crc, parsed, parsedLen));
+    TEST_ASSERT_EQUAL(len - 1, ring->size());
+    write(&packet[len - 1], 1);
+    TEST_ASSERT_EQUAL(CRSF_RX_PACKET, ring->next(crc, parsed, parsedLen));
+}
+
+void test_full_ring(void)
+{
+    uint8_t data[CRSF_RX_RING_SIZE + 10] = {0};
+    TEST_ASSERT_EQUAL(CRSF_RX_RING_SIZE, write(data, sizeof(data)));
+    uint16_t space;
+    ring->writeBuffer(space);
+    TEST_ASSERT_EQUAL(0, space);
+    ring->flush();
+    TEST_ASSERT_EQUAL(0, ring->size());
+}
+
+// A stream as recorded from EdgeTX: RC channels every period, the upper 16 channels every other
+// period and a device ping now and then, all starting with the transmitter address as sync byte
+static uint16_t buildStream(uint8_t *stream, uint16_t size, uint16_t &frames)
+{
+    uint16_t len = 0;
+    frames = 0;
+    for (uint16_t period = 0;; period++)
+    {
+        uint8_t packet[CRSF_MAX_PACKET_LEN];
+        uint8_t packetLen = buildPacket(packet, 22, period);
+        if (period % 2 == 1)
+            packet[2] = CRSF_FRAMETYPE_RC_EXTENDED_CHANNELS_PACKED;
+        if (period % 50 == 49)
+        {
+            packetLen = buildPacket(packet, 2, 0);
+            packet[2] = CRSF_FRAMETYPE_DEVICE_PING;
+            packet[3] = CRSF_ADDRESS_CRSF_TRANSMITTER;
+            packet[4] = CRSF_ADDRESS_RADIO_TRANSMITTER;
+        }
+        packet[0] = CRSF_ADDRESS_CRSF_TRANSMITTER;
+        packet[packetLen - 1] = crc.calc(&packet[2], packetLen - 3);
+        if (len + packetLen > size)
+            return len;
+        memcpy(&stream[len], packet, packetLen);
+        len += packetLen;
+        frames++;
+    }
+}
+
+/*
+ * Feeds the stream the way the UART driver hands it over, in chunks of UART_RX_FIFO_FULL_THRESHOLD
+ * bytes, and reports the parser time per frame and the share of the CPU it takes with the handset
+ * sending frames back to back at each of the baud rates, run with: pio test -e native -f test_crsf_parser -v
+ */
+void test_benchmark(void)
+{
+    const uint32_t ROUNDS = 2000;
+    const uint16_t CHUNK = 64; // UART_RX_FIFO_FULL_THRESHOLD
+    static uint8_t stream[16384];
+    uint16_t streamFrames;
+    const uint16_t streamLen = buildStream(stream, sizeof(stream), streamFrames);
+
+    uint32_t parsed = 0;
+    const auto start = std::chrono::steady_clock::now();
+#if defined(__x86_64__) || defined(__i386__)
+    const uint64_t startCycles = __rdtsc();
+#endif
+    for (uint32_t round = 0; round < ROUNDS; round++)
+    {
+        for (uint16_t pos = 0; pos < streamLen;)
+        {
+            pos += write(&stream[pos], streamLen - pos < CHUNK ? streamLen - pos : CHUNK);
+            const uint8_t *packet;
+            uint8_t len;
+            while (ring->next(crc, packet, len) != CRSF_RX_INCOMPLETE)
+                parsed++;
+        }
+    }
+#if defined(__x86_64__) || defined(__i386__)
+    const double cycles = (double)(__rdtsc() - startCycles) / parsed;
+#else
+    const double cycles = 0;
+#endif
+    const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / parsed;
+    TEST_ASSERT_EQUAL(ROUNDS * streamFrames, parsed);
+
+    const double bytesPerFrame = (double)streamLen / streamFrames;
+    printf("%u frames of %.1f bytes on average: %.1f ns, %.0f host cycles per frame, %.0f frames/s\n",
+           (unsigned)parsed, bytesPerFrame, ns, cycles, 1e9 / ns);
+    const int32_t bauds[] = {400000, 921600, 1870000, 3750000, 5250000};
+    for (int32_t baud : bauds)
+    {
+        const double lineFrames = baud / 10.0 / bytesPerFrame; // 10 bits per byte
+        printf("%7ld baud: %6.0f frames/s back to back, parser load %5.2f %%\n", (long)baud, lineFrames, lineFrames * ns / 1e7);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_packets_split_over_writes);
+    RUN_TEST(test_garbage_is_skipped);
+    RUN_TEST(test_bad_length_and_crc);
+    RUN_TEST(test_incomplete_packet_waits);
+    RUN_TEST(test_full_ring);
+    RUN_TEST(test_benchmark);
+    return UNITY_END();
+}
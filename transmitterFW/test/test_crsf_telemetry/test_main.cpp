@@ -0,0 +1,95 @@
+/*
+ * This file belongs to the CyberBrick ESP-NOW transmitter & receiver project, hosted originally at:
+ * https://github.com/rotorman/CyberBrick_ESPNOW
+ * Copyright (C) 2025, Risto Kõiva
+ *
+ * License GPL-3.0: https://www.gnu.org/licenses/gpl-3.0.html
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <unity.h>
+#include <string.h>
+#include "CrsfTelemetry.h"
+
+static constexpr GENERIC_CRC8<CRSF_CRC_POLY> crc;
+
+void setUp(void) {}
+void tearDown(void) {}
+
+// The frame is complete and its CRC over [type][payload] matches, returns the frame type or 0
+static uint8_t checkFrame(const uint8_t *frame, uint8_t len)
+{
+    if (frame[0] != CRSF_ADDRESS_RADIO_TRANSMITTER || frame[1] != len - CRSF_FRAME_NOT_COUNTED_BYTES)
+        return 0;
+    if (frame[len - 1] != crc.calc(&frame[2], len - 3))
+        return 0;
+    return frame[2];
+}
+
+void test_link_statistics_frame(void)
+{
+    crsfLinkStatistics_t stats = {};
+    stats.uplink_RSSI_1 = 100;
+    stats.uplink_Link_quality = 99;
+    stats.uplink_SNR = -5;
+    stats.rf_Mode = 6;
+    stats.uplink_TX_Power = 3;
+    stats.downlink_RSSI_1 = 80;
+    stats.downlink_Link_quality = 98;
+    stats.downlink_SNR = 7;
+    uint8_t frame[CRSF_LINK_STATISTICS_FRAME_LEN + 1];
+    memset(frame, 0xAA, sizeof(frame));
+    CrsfMakeLinkStatisticsFrame(crc, frame, stats);
+
+    TEST_ASSERT_EQUAL(14, CRSF_LINK_STATISTICS_FRAME_LEN);
+    TEST_ASSERT_EQUAL(CRSF_FRAMETYPE_LINK_STATISTICS, checkFrame(frame, CRSF_LINK_STATISTICS_FRAME_LEN));
+    TEST_ASSERT_EQUAL(0, memcmp(&frame[3], &stats, sizeof(stats)));
+    TEST_ASSERT_EQUAL(0xB4, frame[13]); // CRC worked out bit by bit
+    TEST_ASSERT_EQUAL(0xAA, frame[14]); // nothing written past the frame
+}
+
+void test_battery_frame(void)
+{
+    const uint8_t expected[CRSF_BATTERY_FRAME_LEN] = {0xEA, 0x0A, 0x08, 0x00, 0x7E, 0, 0, 0, 0, 0, 0, 0x7F};
+    uint8_t frame[CRSF_BATTERY_FRAME_LEN + 1];
+    memset(frame, 0xAA, sizeof(frame));
+    CrsfMakeBatteryFrame(crc, frame, 12600);
+
+    TEST_ASSERT_EQUAL(12, CRSF_BATTERY_FRAME_LEN);
+    TEST_ASSERT_EQUAL(0, memcmp(expected, frame, sizeof(expected)));
+    TEST_ASSERT_EQUAL(0xAA, frame[12]);
+}
+
+void test_battery_voltage(void)
+{
+    uint8_t frame[CRSF_BATTERY_FRAME_LEN];
+    // Rounded to 0.1 V, big-endian
+    const uint16_t voltagesMV[] = {0, 49, 50, 3749, 3750, 25200, 65535};
+    const uint16_t voltages[] = {0, 0, 1, 37, 38, 252, 655};
+    for (uint8_t i = 0; i < sizeof(voltages) / sizeof(voltages[0]); i++)
+    {
+        CrsfMakeBatteryFrame(crc, frame, voltagesMV[i]);
+        TEST_ASSERT_EQUAL(CRSF_FRAMETYPE_BATTERY_SENSOR, checkFrame(frame, CRSF_BATTERY_FRAME_LEN));
+        TEST_ASSERT_EQUAL(voltages[i], (frame[3] << 8) | frame[4]);
+        for (uint8_t j = 5; j < CRSF_BATTERY_FRAME_LEN - 1; j++)
+            TEST_ASSERT_EQUAL(0, frame[j]);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_link_statistics_frame);
+    RUN_TEST(test_battery_frame);
+    RUN_TEST(test_battery_voltage);
+    return UNITY_END();
+}
@@ -0,0 +1,237 @@
+/*
+ * This file belongs to the CyberBrick ESP-NOW transmitter & receiver project, hosted originally at:
+ * https://github.com/rotorman/CyberBrick_ESPNOW
+ * Copyright (C) 2025, Risto Kõiva
+ *
+ * License GPL-3.0: https://www.gnu.org/licenses/gpl-3.0.html
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <unity.h>
+#include <stdio.h>
+#include "HandsetBaud.h"
+
+#define SIM_EDGES_PER_FRAME 100 // edges of an RC channels frame seen by the autobaud unit
+#define SIM_TIMEOUT_MS 5000
+
+// The handset UART watchdog of CRSFHandset, with a handset and the autobaud unit simulated in 1 ms steps
+typedef struct
+{
+    // handset
+    uint32_t handsetBaud;
+    bool handsetInverted;
+    uint32_t rcIntervalUS;
+    bool sending;
+    uint32_t startMS; // the first frame is sent at this time
+    // RF module
+    bool halfDuplex;
+    uint32_t baud;
+    bool inverted;
+    bool connected;
+    uint32_t good;
+    uint32_t bad;
+    autobaudUnit_t unit;
+    HandsetBaud search;
+    uint32_t nowMS;
+} sim_t;
+
+static sim_t *sim;
+
+void setUp(void) { sim = new sim_t(); }
+void tearDown(void) { delete sim; }
+
+// @param cachedBaud the baud rate kept in RTC memory over a reset, 0 after power-on
+static void simBegin(uint32_t handsetBaud, uint32_t rcIntervalUS, bool halfDuplex, bool handsetInverted, uint32_t cachedBaud = 0)
+{
+    sim->handsetBaud = handsetBaud;
+    sim->handsetInverted = handsetInverted;
+    sim->rcIntervalUS = rcIntervalUS;
+    sim->sending = true;
+    sim->halfDuplex = halfDuplex;
+    sim->baud = 5250000;
+    sim->inverted = halfDuplex; // on a half duplex UART, go with inverted
+    if (cachedBaud != 0)
+    {
+        sim->baud = cachedBaud;
+        sim->inverted = handsetInverted;
+    }
+    sim->search.begin(sim->nowMS, cachedBaud != 0);
+}
+
+static void simStep()
+{
+    // A frame starts within this ms
+    if (sim->sending && sim->nowMS >= sim->startMS && (sim->nowMS * 1000) % sim->rcIntervalUS < 1000)
+    {
+        if (sim->baud == sim->handsetBaud && sim->inverted == sim->handsetInverted)
+        {
+            sim->good++;
+            sim->connected = true;
+        }
+        else
+            sim->bad++;
+        if (sim->unit.enabled)
+        {
+            sim->unit.edges += SIM_EDGES_PER_FRAME;
+            // The shortest pulses are one bit, the measurement is off by up to a cycle
+            sim->unit.lowPulse = 80000000 / sim->handsetBaud - 3 + (sim->nowMS & 1);
+            sim->unit.highPulse = 80000000 / sim->handsetBaud - 3;
+        }
+    }
+
+    if (sim->search.check(sim->nowMS, sim->connected, sim->rcIntervalUS))
+    {
+        if (sim->bad >= sim->good || !sim->connected)
+        {
+            sim->connected = false;
+            autobaudAction_e action;
+            sim->baud = sim->search.next(sim->unit, sim->halfDuplex, sim->inverted, sim->baud, action);
+            if (action == AUTOBAUD_START)
+            {
+                sim->unit.enabled = true;
+                sim->unit.edges = 0;
+            }
+            else if (action == AUTOBAUD_STOP)
+                sim->unit.enabled = false;
+        }
+        sim->good = 0;
+        sim->bad = 0;
+    }
+    sim->nowMS++;
+}
+
+// @return ms until the handset is connected, SIM_TIMEOUT_MS if it never is
+static uint32_t simTimeToConnect()
+{
+    const uint32_t startMS = sim->nowMS;
+    while (!sim->connected && sim->nowMS - startMS < SIM_TIMEOUT_MS)
+        simStep();
+    return sim->nowMS - startMS;
+}
+
+void test_nearest_baud(void)
+{
+    for (int32_t baud : TxToHandsetBauds)
+    {
+        const uint32_t pulse = 80000000 / baud - 3;
+        TEST_ASSERT_EQUAL(baud, NearestHandsetBaud(pulse, pulse));
+        TEST_ASSERT_EQUAL(baud, NearestHandsetBaud(pulse - 1, pulse)); // the longer pulse counts
+        TEST_ASSERT_TRUE(IsHandsetBaud(baud));
+    }
+    TEST_ASSERT_FALSE(IsHandsetBaud(0));
+    TEST_ASSERT_FALSE(IsHandsetBaud(420000));
+}
+
+void test_interval(void)
+{
+    TEST_ASSERT_EQUAL(HANDSET_BAUD_LOCK_INTERVAL_MS, HandsetBaud::interval(false, 4000));
+    TEST_ASSERT_EQUAL(HANDSET_BAUD_MIN_INTERVAL_MS, HandsetBaud::interval(true, 1000));
+    TEST_ASSERT_EQUAL(HANDSET_BAUD_MIN_INTERVAL_MS, HandsetBaud::interval(true, 4000));
+    TEST_ASSERT_EQUAL(500, HandsetBaud::interval(true, 20000));
+    TEST_ASSERT_EQUAL(HANDSET_BAUD_MAX_INTERVAL_MS, HandsetBaud::interval(true, 100000));
+}
+
+void test_time_to_connect_full_duplex(void)
+{
+    const uint32_t rcIntervalsUS[] = {4000, 20000}; // 250 Hz and 50 Hz
+    for (uint32_t rcIntervalUS : rcIntervalsUS)
+    {
+        for (int32_t baud : TxToHandsetBauds)
+        {
+            tearDown();
+            setUp();
+            simBegin(baud, rcIntervalUS, false, false);
+            const uint32_t lockMS = simTimeToConnect();
+            printf("full duplex %2lu ms frames, %7ld baud: connected after %3lu ms\n",
+                   (unsigned long)(rcIntervalUS / 1000), (long)baud, (unsigned long)lockMS);
+            // The autobaud unit needs HANDSET_AUTOBAUD_MIN_EDGES, then one more check switches over
+            const uint32_t framesMS = (HANDSET_AUTOBAUD_MIN_EDGES / SIM_EDGES_PER_FRAME + 1) * rcIntervalUS / 1000;
+            TEST_ASSERT_LESS_OR_EQUAL(framesMS + 3 * (HANDSET_BAUD_LOCK_INTERVAL_MS + 1), lockMS);
+        }
+    }
+}
+
+void test_time_to_connect_half_duplex(void)
+{
+    // On a half duplex UART the measured rate is tried with both inversions
+    const bool inversions[] = {true, false};
+    for (bool inverted : inversions)
+    {
+        for (int32_t baud : TxToHandsetBauds)
+        {
+            tearDown();
+            setUp();
+            simBegin(baud, 4000, true, inverted);
+            const uint32_t lockMS = simTimeToConnect();
+            printf("half duplex %s, %7ld baud: connected after %3lu ms\n",
+                   inverted ? "inverted    " : "not inverted", (long)baud, (unsigned long)lockMS);
+            TEST_ASSERT_LESS_OR_EQUAL(16 + 4 * (HANDSET_BAUD_LOCK_INTERVAL_MS + 1), lockMS);
+        }
+    }
+}
+
+void test_lost_and_found(void)
+{
+    simBegin(1870000, 4000, false, false);
+    simTimeToConnect();
+    TEST_ASSERT_TRUE(sim->connected);
+
+    // The handset stops, e.g. while EdgeTX changes its baud rate
+    sim->sending = false;
+    uint32_t lostMS = 0;
+    while (sim->connected && lostMS < SIM_TIMEOUT_MS)
+    {
+        simStep();
+        lostMS++;
+    }
+    TEST_ASSERT_FALSE(sim->connected);
+    TEST_ASSERT_LESS_OR_EQUAL(2 * (HandsetBaud::interval(true, 4000) + 1), lostMS);
+
+    sim->handsetBaud = 921600;
+    sim->sending = true;
+    TEST_ASSERT_LESS_THAN(SIM_TIMEOUT_MS, simTimeToConnect());
+    TEST_ASSERT_EQUAL(921600, sim->baud);
+}
+
+void test_cached_baud_grace(void)
+{
+    // After a warm reset the handset takes a while to send again, the cached baud rate is kept
+    // for a whole connected interval before the search starts
+    sim->startMS = HandsetBaud::interval(true, 20000) - 20;
+    simBegin(921600, 20000, false, false, 921600);
+    const uint32_t lockMS = simTimeToConnect();
+    TEST_ASSERT_EQUAL(sim->startMS + 1, lockMS);
+    TEST_ASSERT_EQUAL(921600, sim->baud);
+}
+
+void test_cached_baud_wrong(void)
+{
+    // The handset changed its baud rate during the reset, the search starts after the grace period
+    simBegin(400000, 4000, false, false, 3750000);
+    const uint32_t lockMS = simTimeToConnect();
+    TEST_ASSERT_GREATER_THAN(HandsetBaud::interval(true, 4000), lockMS);
+    TEST_ASSERT_LESS_THAN(SIM_TIMEOUT_MS, lockMS);
+    TEST_ASSERT_EQUAL(400000, sim->baud);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_nearest_baud);
+    RUN_TEST(test_interval);
+    RUN_TEST(test_time_to_connect_full_duplex);
+    RUN_TEST(test_time_to_connect_half_duplex);
+    RUN_TEST(test_lost_and_found);
+    RUN_TEST(test_cached_baud_grace);
+    RUN_TEST(test_cached_baud_wrong);
+    return UNITY_END();
+}
@@ -0,0 +1,160 @@
+/*
+ * This file belongs to the CyberBrick ESP-NOW transmitter & receiver project, hosted originally at:
+ * https://github.com/rotorman/CyberBrick_ESPNOW
+ * Copyright (C) 2025, Risto Kõiva
+ *
+ * License GPL-3.0: https://www.gnu.org/licenses/gpl-3.0.html
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * Sends a stream of history frames over a lossy link and checks that the receiver rebuilds every
+ * lost frame it can, from the records of the next frame which arrives.
+ */
+
+#include <unity.h>
+#include <string.h>
+#include "OTA.h"
+
+#define SIM_FRAMES 5000
+#define SIM_CHANNELS 16
+
+static uint32_t randomState;
+
+// Fixed LCG, so that every run loses the same frames
+static uint32_t nextRandom()
+{
+    randomState = randomState * 1664525 + 1013904223;
+    return randomState >> 8;
+}
+
+// Channels of frame n: sticks moving smoothly, some switches toggling now and then
+static void channelsOf(uint32_t n, uint16_t *channels)
+{
+    for (uint8_t i = 0; i < SIM_CHANNELS; i++)
+    {
+        const uint32_t phase = (n + i * 37) % 200;
+        if (i < 4)
+            channels[i] = 592 + (phase < 100 ? phase : 200 - phase) * 8;
+        else
+            channels[i] = ((n / (50 + i * 13)) & 1) ? 1811 : 172;
+    }
+}
+
+typedef struct
+{
+    uint32_t lost;
+    uint32_t rebuilt;
+    uint32_t unrecoverable;
+    uint32_t mismatches;
+} simResult_t;
+
+static simResult_t simulate(uint8_t depth, uint32_t lossPermille, uint32_t burstPermille)
+{
+    OtaHistoryEncoder encoder(depth);
+    OtaSequenceTracker tracker;
+    simResult_t result = {};
+    uint16_t sent[SIM_FRAMES][SIM_CHANNELS];
+    uint16_t channels[OTA_MAX_CHANNELS];
+    uint8_t frame[OTA_MAX_FRAME_LEN];
+    bool dropping = false;
+
+    for (uint32_t n = 0; n < SIM_FRAMES; n++)
+    {
+        channelsOf(n, sent[n]);
+        const uint8_t len = encoder.build(frame, sent[n], SIM_CHANNELS);
+        const ota_frame_info_t info = {(uint16_t)n, n * 4000, 0};
+        OtaSetFrameInfo(frame, info);
+
+        // Single losses, and bursts continuing with burstPermille
+        dropping = (nextRandom() % 1000) < (dropping ? burstPermille : lossPermille);
+        if (dropping)
+            continue;
+
+        ota_frame_info_t received;
+        const uint32_t lostBefore = tracker.GetLostCount();
+        if (OtaDecodeFrame(frame, len, channels, &received) != SIM_CHANNELS ||
+            !tracker.update(received.sequence, received.txTimeUS) || memcmp(channels, sent[n], sizeof(sent[n])) != 0)
+        {
+            result.mismatches++;
+            continue;
+        }
+        const uint32_t gap = tracker.GetLostCount() - lostBefore;
+
+        result.lost += gap;
+        for (uint32_t back = 1; back <= gap; back++)
+        {
+            if (OtaDecodeHistory(frame, len, back, channels) != SIM_CHANNELS)
+            {
+                result.unrecoverable++;
+                continue;
+            }
+            result.rebuilt++;
+            if (memcmp(channels, sent[n - back], sizeof(sent[n])) != 0)
+                result.mismatches++;
+        }
+    }
+    return result;
+}
+
+void setUp(void)
+{
+    randomState = 12345;
+}
+
+void tearDown(void) {}
+
+void test_single_losses_are_rebuilt(void)
+{
+    const simResult_t result = simulate(2, 100, 0);
+    TEST_ASSERT_GREATER_THAN(300, result.lost);
+    TEST_ASSERT_EQUAL(result.lost, result.rebuilt);
+    TEST_ASSERT_EQUAL(0, result.unrecoverable);
+    TEST_ASSERT_EQUAL(0, result.mismatches);
+}
+
+void test_bursts_up_to_depth_are_rebuilt(void)
+{
+    for (uint8_t depth = 1; depth <= OTA_MAX_HISTORY; depth++)
+    {
+        randomState = 12345;
+        const simResult_t result = simulate(depth, 50, 500);
+        TEST_ASSERT_EQUAL(0, result.mismatches);
+        TEST_ASSERT_EQUAL(result.lost, result.rebuilt + result.unrecoverable);
+        TEST_ASSERT_GREATER_THAN(0, result.unrecoverable);
+    }
+
+    // Deeper history rebuilds more of the same losses
+    randomState = 12345;
+    const simResult_t shallow = simulate(1, 50, 500);
+    randomState = 12345;
+    const simResult_t deep = simulate(OTA_MAX_HISTORY, 50, 500);
+    TEST_ASSERT_EQUAL(shallow.lost, deep.lost);
+    TEST_ASSERT_GREATER_THAN(shallow.rebuilt, deep.rebuilt);
+}
+
+void test_no_history(void)
+{
+    const simResult_t result = simulate(0, 100, 0);
+    TEST_ASSERT_EQUAL(0, result.rebuilt);
+    TEST_ASSERT_EQUAL(result.lost, result.unrecoverable);
+    TEST_ASSERT_EQUAL(0, result.mismatches);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_single_losses_are_rebuilt);
+    RUN_TEST(test_bursts_up_to_depth_are_rebuilt);
+    RUN_TEST(test_no_history);
+    return UNITY_END();
+}
@@ -0,0 +1,172 @@
+/*
+ * This file belongs to the CyberBrick ESP-NOW transmitter & receiver project, hosted originally at:
+ * https://github.com/rotorman/CyberBrick_ESPNOW
+ * Copyright (C) 2025, Risto Kõiva
+ *
+ * License GPL-3.0: https://www.gnu.org/licenses/gpl-3.0.html
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <unity.h>
+#include <stdlib.h>
+#include "MixerSync.h"
+
+#define INTERVAL_US 4000 // 250 Hz
+
+static MixerSync *mixerSync;
+static uint32_t nowMS;
+
+void setUp(void)
+{
+    mixerSync = new MixerSync();
+    mixerSync->setInterval(INTERVAL_US);
+    nowMS = 0;
+    srand(1);
+}
+
+void tearDown(void) { delete mixerSync; }
+
+static void addSample(int32_t deltaUS)
+{
+    mixerSync->addSample(deltaUS, nowMS);
+    nowMS += INTERVAL_US / 1000;
+}
+
+static int32_t jitter(int32_t maxUS)
+{
+    return (rand() % (2 * maxUS + 1)) - maxUS;
+}
+
+void test_estimate_published(void)
+{
+    for (int i = 0; i < MIXER_SYNC_PUBLISH - 1; i++)
+        addSample(1500);
+    TEST_ASSERT_EQUAL(0, mixerSync->getOffsetUS(0));
+    TEST_ASSERT_FALSE(mixerSync->takeResync());
+
+    addSample(1500);
+    TEST_ASSERT_EQUAL(1500 - MIXER_SYNC_TARGET_US, mixerSync->getOffsetUS(0));
+    TEST_ASSERT_TRUE(mixerSync->takeResync());
+    TEST_ASSERT_FALSE(mixerSync->takeResync());
+    TEST_ASSERT_EQUAL(1500, mixerSync->getStats().phaseUS);
+}
+
+void test_phase_is_folded(void)
+{
+    // A handset packet just after the send is slightly early, not almost an interval late
+    for (int i = 0; i < MIXER_SYNC_AVERAGE; i++)
+        addSample(INTERVAL_US - 50);
+    TEST_ASSERT_EQUAL(-50 - MIXER_SYNC_TARGET_US, mixerSync->getOffsetUS(0));
+}
+
+void test_deadband(void)
+{
+    for (int i = 0; i < MIXER_SYNC_AVERAGE; i++)
+        addSample(MIXER_SYNC_TARGET_US + MIXER_SYNC_DEADBAND_US - 2);
+    TEST_ASSERT_EQUAL(0, mixerSync->getOffsetUS(0));
+}
+
+void test_outlier_rejected(void)
+{
+    for (int i = 0; i < 50; i++)
+        addSample(1500 + jitter(10));
+    const int32_t before = mixerSync->getStats().phaseUS;
+    addSample(2500); // a late handset packet
+    TEST_ASSERT_EQUAL(1, mixerSync->getStats().outliers);
+    TEST_ASSERT_INT_WITHIN(2, before, mixerSync->getStats().phaseUS);
+    TEST_ASSERT_INT_WITHIN(15, 1500, mixerSync->getStats().phaseUS);
+    TEST_ASSERT_LESS_OR_EQUAL(10, mixerSync->getStats().jitterUS);
+    TEST_ASSERT_EQUAL(1, mixerSync->getStats().acquisitions);
+}
+
+void test_reacquire_after_outlier_run(void)
+{
+    for (int i = 0; i < 50; i++)
+        addSample(1500);
+    TEST_ASSERT_TRUE(mixerSync->takeResync());
+
+    // The mixer moved, e.g. after the handset changed its rate
+    for (int i = 0; i < MIXER_SYNC_REACQUIRE; i++)
+        addSample(500);
+    TEST_ASSERT_EQUAL(2, mixerSync->getStats().acquisitions);
+    TEST_ASSERT_EQUAL(0, mixerSync->getOffsetUS(0));
+    for (int i = 0; i < MIXER_SYNC_PUBLISH; i++)
+        addSample(500);
+    TEST_ASSERT_TRUE(mixerSync->takeResync());
+    TEST_ASSERT_EQUAL(500 - MIXER_SYNC_TARGET_US, mixerSync->getOffsetUS(0));
+}
+
+void test_settle_after_correction(void)
+{
+    for (int i = 0; i < MIXER_SYNC_AVERAGE; i++)
+        addSample(1500);
+    const int32_t offsetUS = mixerSync->getOffsetUS(0);
+    mixerSync->correctionSent(offsetUS);
+    addSample(1500); // before the mixer moved
+    TEST_ASSERT_EQUAL(0, mixerSync->getOffsetUS(0));
+
+    // The mixer moved, the samples around the move are not averaged
+    for (int i = 1; i < MIXER_SYNC_SETTLE; i++)
+        addSample(1500 - offsetUS);
+    for (int i = 0; i < MIXER_SYNC_PUBLISH; i++)
+        addSample(1500 - offsetUS);
+    TEST_ASSERT_EQUAL(MIXER_SYNC_TARGET_US, mixerSync->getStats().phaseUS);
+    TEST_ASSERT_EQUAL(0, mixerSync->getOffsetUS(0));
+    TEST_ASSERT_EQUAL(0, mixerSync->getStats().outliers);
+}
+
+void test_drift_tracked(void)
+{
+    // The handset clock runs 250 ppm slower than the send timer, 1 us per interval
+    for (int i = 0; i < 1500; i++)
+        addSample(300 + i);
+    TEST_ASSERT_INT_WITHIN(25, 250, mixerSync->getStats().driftPPM);
+
+    // Half of the drift until the next correction is included
+    const int32_t nowOffsetUS = mixerSync->getOffsetUS(0);
+    TEST_ASSERT_INT_WITHIN(3, 300 + 1500 - 1 - MIXER_SYNC_TARGET_US, nowOffsetUS);
+    TEST_ASSERT_INT_WITHIN(10, nowOffsetUS + 50, mixerSync->getOffsetUS(100 * INTERVAL_US));
+}
+
+void test_mixer_converges(void)
+{
+    // The handset moves its mixer by every correction, as EdgeTX does with the mixerSync packets
+    int32_t phaseUS = 1700;
+    for (int i = 0; i < 500; i++)
+    {
+        addSample(phaseUS + jitter(15));
+        if (i % 25 == 24)
+        {
+            const int32_t offsetUS = mixerSync->getOffsetUS(25 * INTERVAL_US);
+            phaseUS -= offsetUS;
+            mixerSync->correctionSent(offsetUS);
+        }
+    }
+    TEST_ASSERT_INT_WITHIN(MIXER_SYNC_LOCK_US, MIXER_SYNC_TARGET_US, phaseUS);
+    TEST_ASSERT_NOT_EQUAL(0, mixerSync->getStats().convergenceMS);
+    TEST_ASSERT_EQUAL(0, mixerSync->getStats().outliers);
+    TEST_ASSERT_EQUAL(1, mixerSync->getStats().acquisitions);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_estimate_published);
+    RUN_TEST(test_phase_is_folded);
+    RUN_TEST(test_deadband);
+    RUN_TEST(test_outlier_rejected);
+    RUN_TEST(test_reacquire_after_outlier_run);
+    RUN_TEST(test_settle_after_correction);
+    RUN_TEST(test_drift_tracked);
+    RUN_TEST(test_mixer_converges);
+    return UNITY_END();
+}
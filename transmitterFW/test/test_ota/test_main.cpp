@@ -0,0 +1,252 @@
+/*
+ * This file belongs to the CyberBrick ESP-NOW transmitter & receiver project, hosted originally at:
+ * https://github.com/rotorman/CyberBrick_ESPNOW
+ * Copyright (C) 2025, Risto Kõiva
+ *
+ * License GPL-3.0: https://www.gnu.org/licenses/gpl-3.0.html
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <unity.h>
+#include <string.h>
+#include "OTA.h"
+
+static uint16_t channels[OTA_MAX_CHANNELS];
+static uint16_t decoded[OTA_MAX_CHANNELS];
+static uint8_t frame[OTA_MAX_FRAME_LEN];
+
+void setUp(void)
+{
+    for (uint8_t i = 0; i < OTA_MAX_CHANNELS; i++)
+        channels[i] = (uint16_t)(172 + i * 53);
+    memset(decoded, 0, sizeof(decoded));
+    memset(frame, 0, sizeof(frame));
+}
+
+void tearDown(void) {}
+
+void test_pack_unpack_all_values(void)
+{
+    uint8_t packed[OTA_PACKED_BYTES(OTA_MAX_CHANNELS)];
+    for (uint16_t value = 0; value <= OTA_CHANNEL_MASK; value += OTA_MAX_CHANNELS)
+    {
+        for (uint8_t i = 0; i < OTA_MAX_CHANNELS; i++)
+            channels[i] = (value + i) & OTA_CHANNEL_MASK;
+        TEST_ASSERT_EQUAL(OTA_PACKED_BYTES(OTA_MAX_CHANNELS), OtaPackChannels(packed, channels, OTA_MAX_CHANNELS));
+        OtaUnpackChannels(decoded, packed, OTA_MAX_CHANNELS);
+        TEST_ASSERT_EQUAL_UINT16_ARRAY(channels, decoded, OTA_MAX_CHANNELS);
+    }
+}
+
+void test_channels_frame_round_trip(void)
+{
+    for (uint8_t count = OTA_CHANNELS_PER_GROUP; count <= OTA_MAX_CHANNELS; count += OTA_CHANNELS_PER_GROUP)
+    {
+        const uint8_t len = OtaBuildChannelsFrame(frame, channels, count);
+        TEST_ASSERT_EQUAL(OTA_HEADER_LEN + OTA_CHANNELS_BYTES(count), len);
+        TEST_ASSERT_EQUAL(count, OtaDecodeFrame(frame, len, decoded));
+        TEST_ASSERT_EQUAL_UINT16_ARRAY(channels, decoded, count);
+    }
+}
+
+void test_frame_info_round_trip(void)
+{
+    const ota_frame_info_t info = {0xBEEF, 0x12345678, 1234};
+    ota_frame_info_t read;
+    const uint8_t len = OtaBuildChannelsFrame(frame, channels, 16);
+    OtaSetFrameInfo(frame, info);
+    TEST_ASSERT_EQUAL(16, OtaDecodeFrame(frame, len, decoded, &read));
+    TEST_ASSERT_EQUAL_HEX16(info.sequence, read.sequence);
+    TEST_ASSERT_EQUAL_UINT32(info.txTimeUS, read.txTimeUS);
+    TEST_ASSERT_EQUAL_UINT16(info.dataAgeUS, read.dataAgeUS);
+}
+
+void test_legacy_frame(void)
+{
+    uint8_t legacy[OTA_LEGACY_FRAME_LEN];
+    for (uint8_t i = 0; i < OTA_MAX_CHANNELS; i++)
+    {
+        legacy[i * 2] = channels[i] & 0xFF;
+        legacy[i * 2 + 1] = channels[i] >> 8;
+    }
+    TEST_ASSERT_EQUAL(OTA_MAX_CHANNELS, OtaDecodeFrame(legacy, OTA_LEGACY_FRAME_LEN, decoded));
+    TEST_ASSERT_EQUAL_UINT16_ARRAY(channels, decoded, OTA_MAX_CHANNELS);
+}
+
+void test_history_frame_of_legacy_length(void)
+{
+    // Frames A, B, B of 32 channels with one changed channel between A and B. The records of
+    // the third frame take 4 and 6 bytes, which makes the frame as long as a legacy frame.
+    OtaHistoryEncoder encoder(2);
+    uint16_t a[OTA_MAX_CHANNELS];
+    memcpy(a, channels, sizeof(a));
+    channels[3] = 768;
+    encoder.build(frame, a, OTA_MAX_CHANNELS);
+    encoder.build(frame, channels, OTA_MAX_CHANNELS);
+    const uint8_t len = encoder.build(frame, channels, OTA_MAX_CHANNELS);
+    TEST_ASSERT_EQUAL(OTA_LEGACY_FRAME_LEN, len);
+
+    TEST_ASSERT_EQUAL(OTA_MAX_CHANNELS, OtaDecodeFrame(frame, len, decoded));
+    TEST_ASSERT_EQUAL_UINT16_ARRAY(channels, decoded, OTA_MAX_CHANNELS);
+    TEST_ASSERT_EQUAL(OTA_MAX_CHANNELS, OtaDecodeHistory(frame, len, 2, decoded));
+    TEST_ASSERT_EQUAL_UINT16_ARRAY(a, decoded, OTA_MAX_CHANNELS);
+
+    OtaDeltaDecoder decoder;
+    TEST_ASSERT_EQUAL(OTA_MAX_CHANNELS, decoder.decode(frame, len, decoded));
+    TEST_ASSERT_EQUAL_UINT16_ARRAY(channels, decoded, OTA_MAX_CHANNELS);
+}
+
+void test_truncated_history_frame_is_rejected(void)
+{
+    OtaHistoryEncoder encoder(2);
+    encoder.build(frame, channels, 16);
+    channels[0] = 992;
+    const uint8_t len = encoder.build(frame, channels, 16);
+    TEST_ASSERT_EQUAL(16, OtaDecodeFrame(frame, len, decoded));
+    TEST_ASSERT_EQUAL(-1, OtaDecodeFrame(frame, len - 1, decoded));
+}
+
+void test_delta_frames(void)
+{
+    OtaDeltaEncoder encoder(4);
+    OtaDeltaDecoder decoder;
+    uint8_t len = encoder.build(frame, channels, 16);
+    TEST_ASSERT_EQUAL(OTA_FRAME_KEYFRAME, OTA_HEADER_TYPE(frame[0]));
+    TEST_ASSERT_EQUAL(16, decoder.decode(frame, len, decoded));
+
+    // Two changed channels take 2 bitmap bytes and 3 bytes of values
+    channels[2] = 1811;
+    channels[9] = 172;
+    len = encoder.build(frame, channels, 16);
+    TEST_ASSERT_EQUAL(OTA_FRAME_DELTA, OTA_HEADER_TYPE(frame[0]));
+    TEST_ASSERT_EQUAL(OTA_HEADER_LEN + OTA_KEYFRAME_ID_LEN + 2 + 3, len);
+    TEST_ASSERT_EQUAL(16, decoder.decode(frame, len, decoded));
+    TEST_ASSERT_EQUAL_UINT16_ARRAY(channels, decoded, 16);
+
+    // A lost delta does not matter, the next one refers to the keyframe as well
+    channels[2] = 992;
+    encoder.build(frame, channels, 16);
+    channels[3] = 1500;
+    len = encoder.build(frame, channels, 16);
+    TEST_ASSERT_EQUAL(16, decoder.decode(frame, len, decoded));
+    TEST_ASSERT_EQUAL_UINT16_ARRAY(channels, decoded, 16);
+
+    // Every keyframe interval and on request
+    len = encoder.build(frame, channels, 16);
+    TEST_ASSERT_EQUAL(OTA_FRAME_KEYFRAME, OTA_HEADER_TYPE(frame[0]));
+    encoder.requestKeyframe();
+    len = encoder.build(frame, channels, 16);
+    TEST_ASSERT_EQUAL(OTA_FRAME_KEYFRAME, OTA_HEADER_TYPE(frame[0]));
+    TEST_ASSERT_EQUAL(16, decoder.decode(frame, len, decoded));
+    TEST_ASSERT_EQUAL_UINT16_ARRAY(channels, decoded, 16);
+}
+
+void test_delta_without_keyframe(void)
+{
+    OtaDeltaEncoder encoder;
+    OtaDeltaDecoder decoder;
+    uint8_t keyframe[OTA_MAX_FRAME_LEN];
+    const uint8_t keyframeLen = encoder.build(keyframe, channels, 32);
+    channels[0] = 1000;
+    const uint8_t len = encoder.build(frame, channels, 32);
+    TEST_ASSERT_EQUAL(OTA_FRAME_DELTA, OTA_HEADER_TYPE(frame[0]));
+
+    TEST_ASSERT_EQUAL(-1, decoder.decode(frame, len, decoded));
+    TEST_ASSERT_EQUAL(1, decoder.GetMissingKeyframeCount());
+    TEST_ASSERT_EQUAL(32, decoder.decode(keyframe, keyframeLen, decoded));
+    TEST_ASSERT_EQUAL(32, decoder.decode(frame, len, decoded));
+    TEST_ASSERT_EQUAL_UINT16_ARRAY(channels, decoded, 32);
+}
+
+void test_delta_falls_back_to_keyframe(void)
+{
+    // A delta of all channels is larger than a keyframe
+    OtaDeltaEncoder encoder;
+    encoder.build(frame, channels, 16);
+    for (uint8_t i = 0; i < 16; i++)
+        channels[i]++;
+    encoder.build(frame, channels, 16);
+    TEST_ASSERT_EQUAL(OTA_FRAME_KEYFRAME, OTA_HEADER_TYPE(frame[0]));
+}
+
+void test_telemetry_frame(void)
+{
+    // As sent by the receiver scripts, struct.pack('<BHbH', header, 7400, -67, 1234)
+    const uint8_t received[] = {0x28, 0xe8, 0x1c, 0xbd, 0xd2, 0x04};
+    ota_telemetry_t telemetry;
+    TEST_ASSERT_TRUE(OtaDecodeTelemetryFrame(received, sizeof(received), telemetry));
+    TEST_ASSERT_EQUAL(7400, telemetry.batteryMV);
+    TEST_ASSERT_EQUAL(-67, telemetry.rssiDBM);
+    TEST_ASSERT_EQUAL(1234, telemetry.loopTimeUS);
+
+    TEST_ASSERT_EQUAL(OTA_TELEMETRY_FRAME_LEN, OtaBuildTelemetryFrame(frame, telemetry));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(received, frame, sizeof(received));
+
+    TEST_ASSERT_FALSE(OtaDecodeTelemetryFrame(received, sizeof(received) - 1, telemetry));
+    frame[0] = OTA_HEADER(OTA_FRAME_CHANNELS);
+    TEST_ASSERT_FALSE(OtaDecodeTelemetryFrame(frame, OTA_TELEMETRY_FRAME_LEN, telemetry));
+}
+
+void test_sequence_lost_and_late(void)
+{
+    OtaSequenceTracker tracker;
+    TEST_ASSERT_TRUE(tracker.update(65534, 1000000));
+    TEST_ASSERT_TRUE(tracker.update(65535, 1020000));
+    TEST_ASSERT_TRUE(tracker.update(2, 1080000));
+    TEST_ASSERT_EQUAL(2, tracker.GetLostCount());
+    TEST_ASSERT_FALSE(tracker.update(1, 1060000));
+    TEST_ASSERT_FALSE(tracker.update(2, 1080000));
+    TEST_ASSERT_EQUAL(2, tracker.GetLateCount());
+    TEST_ASSERT_EQUAL(3, tracker.GetReceivedCount());
+    TEST_ASSERT_EQUAL(0, tracker.GetRestartCount());
+}
+
+void test_sequence_transmitter_restart(void)
+{
+    // Sent later than the last frame, but with a smaller sequence number
+    OtaSequenceTracker tracker;
+    TEST_ASSERT_TRUE(tracker.update(100, 50000000));
+    TEST_ASSERT_TRUE(tracker.update(0, 50900000));
+    TEST_ASSERT_TRUE(tracker.update(1, 50920000));
+    TEST_ASSERT_EQUAL(1, tracker.GetRestartCount());
+    TEST_ASSERT_EQUAL(0, tracker.GetLateCount());
+
+    // The timestamps start over as well
+    TEST_ASSERT_TRUE(tracker.update(0, 900000));
+    TEST_ASSERT_TRUE(tracker.update(1, 920000));
+    TEST_ASSERT_EQUAL(2, tracker.GetRestartCount());
+    TEST_ASSERT_EQUAL(0, tracker.GetLostCount());
+
+    // The new sequence happens to be ahead of the old one
+    TEST_ASSERT_TRUE(tracker.update(40, 60000000));
+    TEST_ASSERT_TRUE(tracker.update(60, 700000));
+    TEST_ASSERT_EQUAL(3, tracker.GetRestartCount());
+    TEST_ASSERT_EQUAL(38, tracker.GetLostCount());
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_pack_unpack_all_values);
+    RUN_TEST(test_channels_frame_round_trip);
+    RUN_TEST(test_frame_info_round_trip);
+    RUN_TEST(test_legacy_frame);
+    RUN_TEST(test_history_frame_of_legacy_length);
+    RUN_TEST(test_truncated_history_frame_is_rejected);
+    RUN_TEST(test_delta_frames);
+    RUN_TEST(test_delta_without_keyframe);
+    RUN_TEST(test_delta_falls_back_to_keyframe);
+    RUN_TEST(test_telemetry_frame);
+    RUN_TEST(test_sequence_lost_and_late);
+    RUN_TEST(test_sequence_transmitter_restart);
+    return UNITY_END();
+}
@@ -0,0 +1,173 @@
+/*
+ * This file belongs to the CyberBrick ESP-NOW transmitter & receiver project, hosted originally at:
+ * https://github.com/rotorman/CyberBrick_ESPNOW
+ * Copyright (C) 2025, Risto Kõiva
+ *
+ * License GPL-3.0: https://www.gnu.org/licenses/gpl-3.0.html
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * The unrolled 11-bit channel pack and unpack against the CRSF bitfield layout and the generic
+ * bit accumulator loop, plus a benchmark of both, run with: pio test -e native -f test_pack -v
+ */
+
+#include <unity.h>
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include "crsf_protocol.h"
+#include "OTA.h"
+
+static uint32_t randomState = 1;
+
+static uint16_t nextRandom()
+{
+    randomState = randomState * 1664525 + 1013904223;
+    return randomState >> 16;
+}
+
+// The generic BetaFlight style loops, which the unrolled groups replace
+static uint8_t referencePack(uint8_t *dst, const uint16_t *channels, uint8_t count)
+{
+    uint8_t *const start = dst;
+    uint32_t value = 0;
+    uint8_t bits = 0;
+    for (uint8_t n = 0; n < count; n++)
+    {
+        value |= (uint32_t)(channels[n] & OTA_CHANNEL_MASK) << bits;
+        bits += OTA_CHANNEL_BITS;
+        while (bits >= 8)
+        {
+            *dst++ = (uint8_t)value;
+            value >>= 8;
+            bits -= 8;
+        }
+    }
+    if (bits > 0)
+        *dst++ = (uint8_t)value;
+    return dst - start;
+}
+
+static void referenceUnpack(uint16_t *channels, const uint8_t *src, uint8_t count)
+{
+    uint32_t value = 0;
+    uint8_t bits = 0;
+    for (uint8_t n = 0; n < count; n++)
+    {
+        while (bits < OTA_CHANNEL_BITS)
+        {
+            value |= (uint32_t)*src++ << bits;
+            bits += 8;
+        }
+        channels[n] = value & OTA_CHANNEL_MASK;
+        value >>= OTA_CHANNEL_BITS;
+        bits -= OTA_CHANNEL_BITS;
+    }
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_crsf_layout(void)
+{
+    // Every value at every position of a CRSF RC channels payload
+    uint16_t channels[16] = {0};
+    uint16_t unpacked[16];
+    uint8_t packed[sizeof(crsf_channels_t)];
+    for (uint8_t position = 0; position < 16; position++)
+    {
+        for (uint16_t value = 0; value <= OTA_CHANNEL_MASK; value++)
+        {
+            crsf_channels_t crsf = {};
+            channels[position] = value;
+            switch (position)
+            {
+            case 0: crsf.ch0 = value; break;
+            case 1: crsf.ch1 = value; break;
+            case 2: crsf.ch2 = value; break;
+            case 3: crsf.ch3 = value; break;
+            case 4: crsf.ch4 = value; break;
+            case 5: crsf.ch5 = value; break;
+            case 6: crsf.ch6 = value; break;
+            case 7: crsf.ch7 = value; break;
+            case 8: crsf.ch8 = value; break;
+            case 9: crsf.ch9 = value; break;
+            case 10: crsf.ch10 = value; break;
+            case 11: crsf.ch11 = value; break;
+            case 12: crsf.ch12 = value; break;
+            case 13: crsf.ch13 = value; break;
+            case 14: crsf.ch14 = value; break;
+            case 15: crsf.ch15 = value; break;
+            }
+            TEST_ASSERT_EQUAL(sizeof(crsf), OtaPackChannels(packed, channels, 16));
+            TEST_ASSERT_EQUAL_MEMORY(&crsf, packed, sizeof(crsf));
+            OtaUnpackChannels(unpacked, (const uint8_t *)&crsf, 16);
+            TEST_ASSERT_EQUAL_UINT16_ARRAY(channels, unpacked, 16);
+        }
+        channels[position] = 0;
+    }
+}
+
+void test_against_reference(void)
+{
+    uint16_t channels[OTA_MAX_CHANNELS];
+    uint16_t unpacked[OTA_MAX_CHANNELS];
+    uint16_t expected[OTA_MAX_CHANNELS];
+    uint8_t packed[OTA_PACKED_BYTES(OTA_MAX_CHANNELS)];
+    uint8_t reference[OTA_PACKED_BYTES(OTA_MAX_CHANNELS)];
+    for (uint32_t run = 0; run < 20000; run++)
+    {
+        const uint8_t count = run % (OTA_MAX_CHANNELS + 1);
+        for (uint8_t n = 0; n < count; n++)
+            channels[n] = nextRandom(); // bits above the 11 are dropped
+        TEST_ASSERT_EQUAL(referencePack(reference, channels, count), OtaPackChannels(packed, channels, count));
+        TEST_ASSERT_EQUAL_MEMORY(reference, packed, OTA_PACKED_BYTES(count));
+        OtaUnpackChannels(unpacked, packed, count);
+        referenceUnpack(expected, reference, count);
+        TEST_ASSERT_EQUAL_UINT16_ARRAY(expected, unpacked, count);
+    }
+}
+
+void test_benchmark(void)
+{
+    const uint32_t ROUNDS = 200000;
+    uint16_t channels[OTA_MAX_CHANNELS];
+    uint8_t packed[OTA_PACKED_BYTES(OTA_MAX_CHANNELS)];
+    for (uint16_t &ch : channels)
+        ch = nextRandom() & OTA_CHANNEL_MASK;
+    volatile uint32_t sink = 0;
+
+    auto time = [&](const char *name, auto &&body) {
+        const auto start = std::chrono::steady_clock::now();
+        for (uint32_t n = 0; n < ROUNDS; n++)
+        {
+            body();
+            sink = sink + packed[n % sizeof(packed)] + channels[n % OTA_MAX_CHANNELS];
+        }
+        const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        printf("%-18s %6.1f ns per 32 channels\n", name, ns / ROUNDS);
+    };
+    time("pack unrolled", [&] { OtaPackChannels(packed, channels, OTA_MAX_CHANNELS); });
+    time("pack reference", [&] { referencePack(packed, channels, OTA_MAX_CHANNELS); });
+    time("unpack unrolled", [&] { OtaUnpackChannels(channels, packed, OTA_MAX_CHANNELS); });
+    time("unpack reference", [&] { referenceUnpack(channels, packed, OTA_MAX_CHANNELS); });
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_crsf_layout);
+    RUN_TEST(test_against_reference);
+    RUN_TEST(test_benchmark);
+    return UNITY_END();
+}
@@ -0,0 +1,239 @@
+/*
+ * This file belongs to the CyberBrick ESP-NOW transmitter & receiver project, hosted originally at:
+ * https://github.com/rotorman/CyberBrick_ESPNOW
+ * Copyright (C) 2025, Risto Kõiva
+ *
+ * License GPL-3.0: https://www.gnu.org/licenses/gpl-3.0.html
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <unity.h>
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include "FIFO.h"
+#include "PacketFIFO.h"
+
+static PacketFIFO<64> *fifo;
+
+void setUp(void) { fifo = new PacketFIFO<64>(); }
+void tearDown(void) { delete fifo; }
+
+static bool push(uint8_t len, uint8_t fill)
+{
+    uint8_t *packet = fifo->reserve(len);
+    if (packet == nullptr)
+        return false;
+    memset(packet, fill, len);
+    fifo->commit();
+    return true;
+}
+
+// Pops the oldest packet, returns its fill byte or -1 if it is not filled evenly with len bytes
+static int pop(uint8_t len)
+{
+    uint8_t packetLen;
+    const uint8_t *packet = fifo->peekContiguous(packetLen);
+    if (packet == nullptr || packetLen != len)
+        return -1;
+    const uint8_t fill = packet[0];
+    for (uint8_t i = 1; i < len; i++)
+    {
+        if (packet[i] != fill)
+            return -1;
+    }
+    fifo->release();
+    return fill;
+}
+
+void test_reserve_commit_in_order(void)
+{
+    TEST_ASSERT_TRUE(push(10, 1));
+    TEST_ASSERT_TRUE(push(20, 2));
+    TEST_ASSERT_EQUAL(2, fifo->packets());
+    TEST_ASSERT_EQUAL(32, fifo->size());
+    TEST_ASSERT_EQUAL(10, fifo->frontLength());
+    TEST_ASSERT_EQUAL(1, pop(10));
+    TEST_ASSERT_EQUAL(2, pop(20));
+    TEST_ASSERT_EQUAL(0, fifo->packets());
+    TEST_ASSERT_EQUAL(0, fifo->size());
+
+    uint8_t len;
+    TEST_ASSERT_NULL(fifo->peekContiguous(len));
+    TEST_ASSERT_EQUAL(0, len);
+}
+
+void test_uncommitted_is_not_queued(void)
+{
+    TEST_ASSERT_NOT_NULL(fifo->reserve(10));
+    TEST_ASSERT_EQUAL(0, fifo->packets());
+    TEST_ASSERT_TRUE(push(5, 3)); // replaces the reservation
+    TEST_ASSERT_EQUAL(1, fifo->packets());
+    TEST_ASSERT_EQUAL(3, pop(5));
+}
+
+void test_packets_stay_contiguous(void)
+{
+    // Packet lengths which do not divide the buffer, so the unused end before a wrap changes every time.
+    // Two packets always fit, nothing is dropped.
+    uint8_t next = 0;
+    uint8_t expected = 0;
+    for (int round = 0; round < 200; round++)
+    {
+        const uint8_t len = 5 + round % 17;
+        TEST_ASSERT_TRUE(push(len, next++));
+        if (fifo->packets() > 1)
+            TEST_ASSERT_EQUAL(expected++, pop(fifo->frontLength()));
+    }
+    while (fifo->packets() > 0)
+        TEST_ASSERT_EQUAL(expected++, pop(fifo->frontLength()));
+    TEST_ASSERT_EQUAL(next, expected);
+    TEST_ASSERT_EQUAL(0, fifo->size());
+}
+
+void test_full_drops_oldest(void)
+{
+    TEST_ASSERT_TRUE(push(20, 1));
+    TEST_ASSERT_TRUE(push(20, 2));
+    TEST_ASSERT_TRUE(push(20, 3));
+    TEST_ASSERT_TRUE(push(20, 4)); // does not fit behind the third, starts over in place of the first
+    TEST_ASSERT_EQUAL(3, fifo->packets());
+    TEST_ASSERT_EQUAL(2, pop(20));
+    TEST_ASSERT_EQUAL(3, pop(20));
+    TEST_ASSERT_EQUAL(4, pop(20));
+    TEST_ASSERT_NULL(fifo->reserve(64)); // the length byte must fit as well
+    TEST_ASSERT_NULL(fifo->reserve(0));
+}
+
+void test_packet_being_read_is_kept(void)
+{
+    TEST_ASSERT_TRUE(push(30, 1));
+    TEST_ASSERT_TRUE(push(20, 2));
+    uint8_t len;
+    const uint8_t *packet = fifo->peekContiguous(len);
+    TEST_ASSERT_NOT_NULL(packet);
+
+    // Packets are only dropped from the head, which is being read
+    TEST_ASSERT_FALSE(push(25, 3));
+    TEST_ASSERT_TRUE(push(10, 3));
+    TEST_ASSERT_EQUAL(1, packet[0]);
+    TEST_ASSERT_EQUAL(1, packet[len - 1]);
+    fifo->release();
+    TEST_ASSERT_TRUE(push(25, 4));
+    TEST_ASSERT_EQUAL(2, pop(20));
+    TEST_ASSERT_EQUAL(3, pop(10));
+    TEST_ASSERT_EQUAL(4, pop(25));
+}
+
+void test_drop_unread(void)
+{
+    TEST_ASSERT_TRUE(push(10, 1));
+    TEST_ASSERT_TRUE(push(10, 2));
+    TEST_ASSERT_EQUAL(2, fifo->dropUnread());
+    TEST_ASSERT_EQUAL(0, fifo->packets());
+
+    TEST_ASSERT_TRUE(push(10, 1));
+    TEST_ASSERT_TRUE(push(10, 2));
+    TEST_ASSERT_TRUE(push(10, 3));
+    uint8_t len;
+    TEST_ASSERT_NOT_NULL(fifo->peekContiguous(len));
+    TEST_ASSERT_EQUAL(2, fifo->dropUnread());
+    TEST_ASSERT_TRUE(push(10, 4));
+    TEST_ASSERT_EQUAL(2, fifo->packets());
+    fifo->release();
+    TEST_ASSERT_EQUAL(4, pop(10));
+}
+
+// Writes a CRSF frame of len bytes as the telemetry builders do, field by field
+static void buildFrame(uint8_t *frame, uint8_t len, uint8_t seq)
+{
+    frame[0] = 0xC8;
+    frame[1] = len - 2;
+    frame[2] = 0x08;
+    for (uint8_t i = 3; i < len; i++)
+        frame[i] = seq + i;
+}
+
+/*
+ * Bytes copied and time per telemetry frame from the builder to the UART write, with the frames built
+ * in place in a PacketFIFO and with the former path that built them in a temporary buffer, pushed that
+ * into the byte FIFO and popped it into the output buffer, run with: pio test -e native -f test_packet_fifo -v
+ */
+void test_benchmark(void)
+{
+    const uint32_t FRAMES = 1000000;
+    const uint8_t lengths[] = {12, 12, 19, 64}; // link statistics, battery, GPS, the largest frame
+    static FIFO<128> byteFIFO;
+    static PacketFIFO<128> packetFIFO;
+    uint32_t written = 0;
+
+    auto time = [&](const char *name, auto &&sendFrame) {
+        uint64_t copied = 0;
+        written = 0;
+        const auto start = std::chrono::steady_clock::now();
+        for (uint32_t n = 0; n < FRAMES; n++)
+            copied += sendFrame(lengths[n % sizeof(lengths)], (uint8_t)n);
+        const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        printf("%-28s %5.1f bytes copied, %6.2f ns per frame\n", name, (double)copied / FRAMES, ns / FRAMES);
+    };
+    // write() stands for the UART, it only reads the frame
+    auto write = [&](const uint8_t *frame, uint8_t len) { written += frame[len - 1]; };
+
+    time("temporary buffer, FIFO", [&](uint8_t len, uint8_t seq) {
+        uint8_t temp[64];
+        uint8_t out[64];
+        buildFrame(temp, len, seq);
+        byteFIFO.lock();
+        if (byteFIFO.ensure(len + 1))
+        {
+            byteFIFO.push(len);
+            byteFIFO.pushBytes(temp, len);
+        }
+        byteFIFO.unlock();
+
+        byteFIFO.lock();
+        const uint8_t outLen = byteFIFO.pop();
+        byteFIFO.popBytes(out, outLen);
+        byteFIFO.unlock();
+        write(out, outLen);
+        return 2 * len;
+    });
+    const uint32_t expected = written;
+
+    time("reserve/commit, PacketFIFO", [&](uint8_t len, uint8_t seq) {
+        uint8_t *frame = packetFIFO.reserve(len);
+        buildFrame(frame, len, seq);
+        packetFIFO.commit();
+
+        uint8_t outLen;
+        const uint8_t *out = packetFIFO.peekContiguous(outLen);
+        write(out, outLen);
+        packetFIFO.release();
+        return 0;
+    });
+    TEST_ASSERT_EQUAL_UINT32(expected, written);
+    TEST_ASSERT_EQUAL(0, byteFIFO.size());
+    TEST_ASSERT_EQUAL(0, packetFIFO.size());
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_reserve_commit_in_order);
+    RUN_TEST(test_uncommitted_is_not_queued);
+    RUN_TEST(test_packets_stay_contiguous);
+    RUN_TEST(test_full_drops_oldest);
+    RUN_TEST(test_packet_being_read_is_kept);
+    RUN_TEST(test_drop_unread);
+    RUN_TEST(test_benchmark);
+    return UNITY_END();
+}
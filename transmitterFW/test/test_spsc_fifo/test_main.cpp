@@ -0,0 +1,189 @@
+/*
+ * This file belongs to the CyberBrick ESP-NOW transmitter & receiver project, hosted originally at:
+ * https://github.com/rotorman/CyberBrick_ESPNOW
+ * Copyright (C) 2025, Risto Kõiva
+ *
+ * License GPL-3.0: https://www.gnu.org/licenses/gpl-3.0.html
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <unity.h>
+#include <chrono>
+#include <stdio.h>
+#include <thread>
+#include "FIFO.h"
+#include "SPSCFIFO.h"
+
+#define STRESS_BYTES 1000000 // bytes pushed through the FIFO by the two threads
+
+static SPSCFIFO<64> *fifo;
+
+void setUp(void) { fifo = new SPSCFIFO<64>(); }
+void tearDown(void) { delete fifo; }
+
+void test_push_pop_wraps(void)
+{
+    uint8_t data[24];
+    uint8_t out[24];
+    uint8_t next = 0;
+    uint8_t expected = 0;
+    // 24 bytes do not divide 64, so the copies wrap around the end of the buffer at changing offsets
+    for (int round = 0; round < 100; round++)
+    {
+        for (uint8_t i = 0; i < sizeof(data); i++)
+            data[i] = next++;
+        TEST_ASSERT_TRUE(fifo->pushBytes(data, sizeof(data)));
+        TEST_ASSERT_EQUAL(sizeof(data), fifo->size());
+        TEST_ASSERT_TRUE(fifo->popBytes(out, sizeof(out)));
+        for (uint8_t i = 0; i < sizeof(out); i++)
+            TEST_ASSERT_EQUAL(expected++, out[i]);
+        TEST_ASSERT_EQUAL(0, fifo->size());
+    }
+}
+
+void test_all_or_nothing(void)
+{
+    uint8_t data[40] = {0};
+    uint8_t out[40];
+    TEST_ASSERT_TRUE(fifo->pushBytes(data, sizeof(data)));
+    TEST_ASSERT_EQUAL(24, fifo->free());
+    TEST_ASSERT_FALSE(fifo->pushBytes(data, 25));
+    TEST_ASSERT_EQUAL(40, fifo->size());
+    TEST_ASSERT_TRUE(fifo->pushBytes(data, 24));
+    TEST_ASSERT_EQUAL(0, fifo->free());
+    TEST_ASSERT_FALSE(fifo->pushBytes(data, 1));
+
+    TEST_ASSERT_TRUE(fifo->popBytes(out, 40));
+    TEST_ASSERT_FALSE(fifo->popBytes(out, 25));
+    TEST_ASSERT_FALSE(fifo->peek(out, 25));
+    TEST_ASSERT_EQUAL(24, fifo->size());
+}
+
+void test_peek_and_skip(void)
+{
+    const uint8_t data[] = {1, 2, 3, 4, 5};
+    uint8_t out[5];
+    TEST_ASSERT_TRUE(fifo->pushBytes(data, sizeof(data)));
+    TEST_ASSERT_TRUE(fifo->peek(out, 2));
+    TEST_ASSERT_EQUAL(1, out[0]);
+    TEST_ASSERT_EQUAL(5, fifo->size());
+    fifo->skip(2);
+    TEST_ASSERT_TRUE(fifo->popBytes(out, 1));
+    TEST_ASSERT_EQUAL(3, out[0]);
+    fifo->skip(100); // only what is there
+    TEST_ASSERT_EQUAL(0, fifo->size());
+    TEST_ASSERT_TRUE(fifo->pushBytes(data, sizeof(data)));
+    TEST_ASSERT_EQUAL(5, fifo->size());
+}
+
+void test_threads(void)
+{
+    // Records of a length byte and a running counter, as the telemetry is queued, pushed and popped
+    // by two threads without any lock
+    std::thread producer([] {
+        uint8_t record[16];
+        uint8_t counter = 0;
+        uint32_t pushed = 0;
+        while (pushed < STRESS_BYTES)
+        {
+            const uint8_t len = 2 + (pushed / 3) % (sizeof(record) - 1);
+            record[0] = len;
+            for (uint8_t i = 1; i < len; i++)
+                record[i] = counter++;
+            while (!fifo->pushBytes(record, len))
+                std::this_thread::yield();
+            pushed += len;
+        }
+    });
+
+    uint8_t record[16];
+    uint8_t counter = 0;
+    uint32_t popped = 0;
+    uint32_t errors = 0;
+    while (popped < STRESS_BYTES)
+    {
+        if (!fifo->peek(record, 1))
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        const uint8_t len = record[0];
+        if (len < 2 || len > sizeof(record))
+        {
+            errors++;
+            break;
+        }
+        while (!fifo->popBytes(record, len))
+            std::this_thread::yield();
+        for (uint8_t i = 1; i < len; i++)
+        {
+            if (record[i] != counter++)
+                errors++;
+        }
+        popped += len;
+    }
+    producer.join();
+    TEST_ASSERT_EQUAL(0, errors);
+    TEST_ASSERT_EQUAL(0, fifo->size());
+}
+
+/*
+ * Time per telemetry record pushed and popped, through the lock-free FIFO and through the locked FIFO
+ * the telemetry queue used before, run with: pio test -e native -f test_spsc_fifo -v
+ */
+void test_benchmark(void)
+{
+    const uint32_t RECORDS = 2000000;
+    static FIFO<128> locked;
+    uint8_t record[12] = {0}; // the size of the telemetry records of main.cpp
+    uint8_t out[sizeof(record)];
+    uint32_t sum = 0;
+    uint32_t expected = 0;
+
+    auto time = [&](const char *name, auto &&pushPop) {
+        const auto start = std::chrono::steady_clock::now();
+        for (uint32_t n = 0; n < RECORDS; n++)
+        {
+            record[0] = (uint8_t)n;
+            pushPop();
+            sum += out[0];
+            expected += record[0];
+        }
+        const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        printf("%-24s %6.2f ns per record, %6.1f MB/s\n", name, ns / RECORDS, RECORDS * sizeof(record) * 1e3 / ns);
+    };
+    time("FIFO, lock/unlock", [&] {
+        locked.atomicPushBytes(record, sizeof(record));
+        locked.lock();
+        locked.popBytes(out, sizeof(out));
+        locked.unlock();
+    });
+    time("SPSCFIFO", [&] {
+        fifo->pushBytes(record, sizeof(record));
+        fifo->popBytes(out, sizeof(out));
+    });
+    // Both carried every record, with the record counter in the first byte
+    TEST_ASSERT_EQUAL_UINT32(expected, sum);
+    TEST_ASSERT_EQUAL(0, locked.size());
+    TEST_ASSERT_EQUAL(0, fifo->size());
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_push_pop_wraps);
+    RUN_TEST(test_all_or_nothing);
+    RUN_TEST(test_peek_and_skip);
+    RUN_TEST(test_threads);
+    RUN_TEST(test_benchmark);
+    return UNITY_END();
+}
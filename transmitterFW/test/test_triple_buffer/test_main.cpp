@@ -0,0 +1,93 @@
+/*
+ * This file belongs to the CyberBrick ESP-NOW transmitter & receiver project, hosted originally at:
+ * https://github.com/rotorman/CyberBrick_ESPNOW
+ * Copyright (C) 2025, Risto Kõiva
+ *
+ * License GPL-3.0: https://www.gnu.org/licenses/gpl-3.0.html
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <unity.h>
+#include <thread>
+#include "TripleBuffer.h"
+
+typedef struct
+{
+    uint32_t serial;
+    uint16_t ch[32]; // all set to the serial, a torn read mixes two of them
+} snapshot_t;
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_read_returns_newest(void)
+{
+    TripleBuffer<uint32_t> buffer;
+    TEST_ASSERT_FALSE(buffer.hasNewValue());
+    for (uint32_t value = 1; value <= 3; value++)
+    {
+        buffer.writeBuffer() = value;
+        buffer.publish();
+    }
+    TEST_ASSERT_TRUE(buffer.hasNewValue());
+    TEST_ASSERT_EQUAL(3, buffer.read());
+    TEST_ASSERT_FALSE(buffer.hasNewValue());
+    // Stays valid until the next read
+    buffer.writeBuffer() = 4;
+    TEST_ASSERT_EQUAL(3, buffer.read());
+    buffer.publish();
+    TEST_ASSERT_EQUAL(4, buffer.read());
+    TEST_ASSERT_EQUAL(4, buffer.read());
+}
+
+void test_no_torn_reads(void)
+{
+    static TripleBuffer<snapshot_t> buffer;
+    const uint32_t WRITES = 200000;
+
+    std::thread writer([]() {
+        for (uint32_t serial = 1; serial <= WRITES; serial++)
+        {
+            snapshot_t &snapshot = buffer.writeBuffer();
+            snapshot.serial = serial;
+            for (uint16_t &ch : snapshot.ch)
+                ch = (uint16_t)serial;
+            buffer.publish();
+            if (serial % 64 == 0)
+                std::this_thread::yield();
+        }
+    });
+
+    uint32_t last = 0;
+    bool torn = false;
+    bool backwards = false;
+    while (last < WRITES)
+    {
+        const snapshot_t &snapshot = buffer.read();
+        for (uint16_t ch : snapshot.ch)
+            torn |= ch != (uint16_t)snapshot.serial;
+        backwards |= snapshot.serial < last;
+        last = snapshot.serial;
+        std::this_thread::yield();
+    }
+    writer.join();
+    TEST_ASSERT_FALSE(torn);
+    TEST_ASSERT_FALSE(backwards);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_read_returns_newest);
+    RUN_TEST(test_no_torn_reads);
+    return UNITY_END();
+}